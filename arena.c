@@ -0,0 +1,112 @@
+/* Copyright (C) 2020 fosslinux
+ * This file is part of mescc-tools.
+ *
+ * mescc-tools is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mescc-tools is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mescc-tools.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * ARENAS
+ * Bump allocators for memory with a known lifetime. Everything allocated
+ * from an arena is thrown away at once by arena_reset(), after which the
+ * same memory is handed out again. Under M2-Planet free() does nothing,
+ * so this is the only way memory ever gets reused.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "kaem.h"
+
+struct Arena* arena_new(int chunk_size)
+{
+	struct Arena* a = calloc(1, sizeof(struct Arena));
+	require(a != NULL, "Memory initialization of arena failed\n");
+	a->chunk_size = chunk_size;
+	return a;
+}
+
+/* Get a new chunk from the system, big enough for at least size bytes */
+struct ArenaChunk* arena_chunk(struct Arena* a, int size)
+{
+	struct ArenaChunk* c = calloc(1, sizeof(struct ArenaChunk));
+	require(c != NULL, "Memory initialization of arena chunk failed\n");
+	if(size < a->chunk_size) size = a->chunk_size;
+	c->memory = calloc(size, sizeof(char));
+	require(c->memory != NULL, "Memory initialization of arena chunk failed\n");
+	c->size = size;
+	a->reserved = a->reserved + size;
+	return c;
+}
+
+/* Like calloc(), but from the arena */
+void* arena_calloc(struct Arena* a, int count, int size)
+{
+	/* Keep everything 8 byte aligned */
+	size = (((count * size) + 7) / 8) * 8;
+	struct ArenaChunk* c = a->current;
+	/* The chunks after current are empty since the last reset */
+	while((NULL != c) && (c->used + size > c->size))
+	{
+		c = c->next;
+	}
+	if(NULL == c)
+	{
+		c = arena_chunk(a, size);
+		if(NULL == a->first) a->first = c;
+		else a->last->next = c;
+		a->last = c;
+	}
+	a->current = c;
+
+	char* r = c->memory + c->used;
+	c->used = c->used + size;
+	/* Memory from before a reset has to be cleared again */
+	memset(r, 0, size);
+
+	a->used = a->used + size;
+	if(a->used > a->peak) a->peak = a->used;
+	return r;
+}
+
+/* Throw away everything in the arena, keeping its memory for next time */
+void arena_reset(struct Arena* a)
+{
+	struct ArenaChunk* c = a->first;
+	while(NULL != c)
+	{
+		c->used = 0;
+		c = c->next;
+	}
+	a->current = a->first;
+	a->used = 0;
+}
+
+/* Copy a string into the arena */
+char* arena_string(struct Arena* a, char* s)
+{
+	char* r = arena_calloc(a, string_length(s) + 1, sizeof(char));
+	copy_string(r, s);
+	return r;
+}
+
+/* Describe how much an arena has used, for --stats */
+void arena_report(char* name, struct Arena* a)
+{
+	file_print(name, stderr);
+	file_print(": ", stderr);
+	file_print(numerate_number(a->peak), stderr);
+	file_print(" bytes high-water, ", stderr);
+	file_print(numerate_number(a->reserved), stderr);
+	file_print(" bytes reserved\n", stderr);
+}
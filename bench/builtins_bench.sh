@@ -0,0 +1,50 @@
+#!/bin/bash
+# Copyright (C) 2020 fosslinux
+# This file is part of mescc-tools.
+#
+# mescc-tools is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# mescc-tools is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with mescc-tools.  If not, see <http://www.gnu.org/licenses/>.
+
+# Processes spawned and wall time for the housekeeping a bootstrap does
+# around each build step, with kaem doing mkdir, rm and the like itself
+# and then with --no-builtins running the real programs.
+
+STEPS=${1:-500}
+DIR=$(mktemp -d)
+trap 'rm -rf ${DIR}' EXIT
+
+i=0
+while [ $i -lt $STEPS ] ; do
+	echo "mkdir -p \${OUT}/stage$i/bin"
+	echo "touch \${OUT}/stage$i/file.c"
+	echo "chmod 755 \${OUT}/stage$i/file.c"
+	echo "mv \${OUT}/stage$i/file.c \${OUT}/stage$i/bin/file"
+	echo "ln -sf file \${OUT}/stage$i/bin/link"
+	echo "rm -f \${OUT}/stage$i/bin/link \${OUT}/stage$i/missing"
+	i=$((i + 1))
+done > ${DIR}/script.kaem
+
+echo "$(wc -l < ${DIR}/script.kaem) commands"
+
+time_it()
+{
+	rm -rf ${DIR}/out
+	local start=$(date +%s%N)
+	OUT=${DIR}/out bin/kaem --stats "$@" -f ${DIR}/script.kaem 2>&1 | grep "processes spawned" | tr '\n' ' ' || exit 1
+	echo "$(( ($(date +%s%N) - start) / 1000000 )) ms"
+}
+
+for run in 1 2 3 ; do
+	echo -n "builtins:      "; time_it
+	echo -n "--no-builtins: "; time_it --no-builtins
+done
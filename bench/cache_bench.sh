@@ -0,0 +1,48 @@
+#!/bin/bash
+# Copyright (C) 2020 fosslinux
+# This file is part of mescc-tools.
+#
+# mescc-tools is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# mescc-tools is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with mescc-tools.  If not, see <http://www.gnu.org/licenses/>.
+
+# Startup time with and without a warm --cache-dir, on a large generated
+# script. --check stops kaem once the script is compiled, so this is the
+# cost of getting from the script on disk to something ready to run.
+
+LINES=${1:-200000}
+DIR=$(mktemp -d)
+trap 'rm -rf ${DIR}' EXIT
+
+i=0
+while [ $i -lt $LINES ] ; do
+	echo "# Stage $i"
+	echo "M2-Planet --architecture amd64 -f \${SRC}/lib/file$i.c -f \${SRC}/file$i.c --debug -o \${OUT:-out}/file$i.M1"
+	echo "blood-elf --64 -f \${OUT:-out}/file$i.M1 -o \${OUT:-out}/file$i-footer.M1"
+	i=$((i + 3))
+done > ${DIR}/script.kaem
+
+echo "$(wc -l < ${DIR}/script.kaem) lines, $(wc -c < ${DIR}/script.kaem) bytes"
+
+time_it()
+{
+	local start=$(date +%s%N)
+	bin/kaem --check "$@" -f ${DIR}/script.kaem || exit 1
+	echo "$(( ($(date +%s%N) - start) / 1000000 )) ms"
+}
+
+echo -n "no cache:   "; time_it
+mkdir ${DIR}/cache
+echo -n "cold cache: "; time_it --cache-dir ${DIR}/cache
+for run in 1 2 3 ; do
+	echo -n "warm cache: "; time_it --cache-dir ${DIR}/cache
+done
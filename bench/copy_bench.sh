@@ -0,0 +1,53 @@
+#!/bin/bash
+# Copyright (C) 2020 fosslinux
+# This file is part of mescc-tools.
+#
+# mescc-tools is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# mescc-tools is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with mescc-tools.  If not, see <http://www.gnu.org/licenses/>.
+
+# Throughput of cp and cat on 1 MB, 100 MB and 1 GB files, done by kaem
+# itself (copy_file_range, sendfile or a reflink) and with --no-builtins
+# by the real programs. Give the sizes in MB to try others.
+
+SIZES=${@:-1 100 1024}
+DIR=$(mktemp -d)
+trap 'rm -rf ${DIR}' EXIT
+
+echo "cp \${DIR}/in \${DIR}/copy" > ${DIR}/cp.kaem
+echo "cat \${DIR}/in \${DIR}/in" > ${DIR}/cat.kaem
+
+# The best of three, as writeback of the last run's files gets in the way
+time_it()
+{
+	local MB=$1
+	shift
+	local best=
+	for run in 1 2 3 ; do
+		rm -f ${DIR}/copy ${DIR}/joined
+		sync
+		local start=$(date +%s%N)
+		DIR=${DIR} bin/kaem "$@" -f ${DIR}/cp.kaem || exit 1
+		DIR=${DIR} bin/kaem "$@" -f ${DIR}/cat.kaem > ${DIR}/joined || exit 1
+		local ms=$(( ($(date +%s%N) - start) / 1000000 + 1 ))
+		cmp -s ${DIR}/in ${DIR}/copy || { echo "cp went wrong" ; exit 1 ; }
+		if [ -z "$best" ] || [ $ms -lt $best ] ; then best=$ms ; fi
+	done
+	echo "$best ms, $(( MB * 3 * 1000 / best )) MB/s"
+}
+
+for MB in ${SIZES} ; do
+	head -c $((MB * 1024 * 1024)) /dev/urandom > ${DIR}/in
+	echo "== ${MB} MB (cp once, then cat it twice)"
+	echo -n "--no-builtins: "; time_it ${MB} --no-builtins
+	echo -n "builtins:      "; time_it ${MB}
+done
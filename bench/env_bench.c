@@ -0,0 +1,129 @@
+/* Copyright (C) 2020 fosslinux
+ * This file is part of mescc-tools.
+ *
+ * mescc-tools is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mescc-tools is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mescc-tools.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Microbenchmark for the environment in env.c. Sets 10k variables, looks
+ * each of them up, then reassigns one variable 10k times, looking up the
+ * last variable set after each; once with the hash table and once with
+ * the linked list kaem used to keep (append on every assignment, first
+ * match wins on lookup).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "../kaem.h"
+
+#define COUNT 10000
+
+struct Node
+{
+	char* var;
+	char* value;
+	struct Node* next;
+};
+
+struct Node* head;
+
+/* The old add_envar(): walk to the end and append */
+void list_set(char* name, char* value)
+{
+	struct Node* n = calloc(1, sizeof(struct Node));
+	n->var = name;
+	n->value = value;
+	if(NULL == head)
+	{
+		head = n;
+		return;
+	}
+	struct Node* last = head;
+	while(NULL != last->next) last = last->next;
+	last->next = n;
+}
+
+/* The old env_lookup() */
+char* list_lookup(char* name)
+{
+	struct Node* n;
+	for(n = head; NULL != n; n = n->next)
+	{
+		if(match(name, n->var)) return n->value;
+	}
+	return NULL;
+}
+
+char* names[COUNT];
+/* Number of lookups that found something; keeps them from being optimized away */
+long found;
+
+double seconds(void)
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + (t.tv_nsec / 1e9);
+}
+
+int main(void)
+{
+	int i;
+	double start;
+	double list_set_time, list_get_time, list_again_time;
+	double hash_set_time, hash_get_time, hash_again_time;
+
+	line_arena = arena_new(64 * 1024);
+	long_arena = arena_new(256 * 1024);
+	for(i = 0; i < COUNT; i = i + 1)
+	{
+		names[i] = calloc(16, sizeof(char));
+		sprintf(names[i], "VAR_%d", i);
+	}
+
+	start = seconds();
+	for(i = 0; i < COUNT; i = i + 1) list_set(names[i], "value");
+	list_set_time = seconds() - start;
+	start = seconds();
+	for(i = 0; i < COUNT; i = i + 1) if(NULL != list_lookup(names[i])) found = found + 1;
+	list_get_time = seconds() - start;
+	start = seconds();
+	for(i = 0; i < COUNT; i = i + 1)
+	{
+		list_set("AGAIN", "value");
+		if(NULL != list_lookup(names[COUNT - 1])) found = found + 1;
+	}
+	list_again_time = seconds() - start;
+
+	env = env_new(64);
+	start = seconds();
+	for(i = 0; i < COUNT; i = i + 1) env_set(names[i], "value");
+	hash_set_time = seconds() - start;
+	start = seconds();
+	for(i = 0; i < COUNT; i = i + 1) if(NULL != env_lookup(names[i])) found = found + 1;
+	hash_get_time = seconds() - start;
+	start = seconds();
+	for(i = 0; i < COUNT; i = i + 1)
+	{
+		env_set("AGAIN", "value");
+		if(NULL != env_lookup(names[COUNT - 1])) found = found + 1;
+	}
+	hash_again_time = seconds() - start;
+
+	printf("%d variables        list %9.3f ms   hash %9.3f ms\n", COUNT, list_set_time * 1e3, hash_set_time * 1e3);
+	printf("%d lookups          list %9.3f ms   hash %9.3f ms\n", COUNT, list_get_time * 1e3, hash_get_time * 1e3);
+	printf("%d reassignments    list %9.3f ms   hash %9.3f ms\n", COUNT, list_again_time * 1e3, hash_again_time * 1e3);
+	if(found != 4 * COUNT) return EXIT_FAILURE;
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,61 @@
+#!/bin/bash
+# Copyright (C) 2020 fosslinux
+# This file is part of mescc-tools.
+#
+# mescc-tools is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# mescc-tools is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with mescc-tools.  If not, see <http://www.gnu.org/licenses/>.
+
+# Writing out generated files of 500 lines: one sh -c "echo ... >> file"
+# per line as scripts have had to, then one here-document per file with
+# cat <<EOF > file, which kaem does without running anything.
+
+FILES=${1:-5}
+DIR=$(mktemp -d)
+trap 'rm -rf ${DIR}' EXIT
+
+f=0
+while [ $f -lt $FILES ] ; do
+	i=0
+	while [ $i -lt 500 ] ; do
+		echo "sh -c \"echo '#define VALUE_$i $i' >> \${OUT}/gen$f.h\""
+		i=$((i + 1))
+	done
+	f=$((f + 1))
+done > ${DIR}/echo.kaem
+
+f=0
+while [ $f -lt $FILES ] ; do
+	echo "cat <<EOF > \${OUT}/gen$f.h"
+	i=0
+	while [ $i -lt 500 ] ; do
+		echo "#define VALUE_$i $i"
+		i=$((i + 1))
+	done
+	echo "EOF"
+	f=$((f + 1))
+done > ${DIR}/here.kaem
+
+time_it()
+{
+	rm -rf ${DIR}/out
+	mkdir ${DIR}/out
+	local start=$(date +%s%N)
+	OUT=${DIR}/out bin/kaem --stats -f ${DIR}/$1 2>&1 | grep "processes spawned" | tr '\n' ' ' || exit 1
+	echo "$(( ($(date +%s%N) - start) / 1000000 )) ms"
+}
+
+echo "${FILES} files of 500 lines"
+echo -n "sh -c echo:     "; time_it echo.kaem
+cp ${DIR}/out/gen0.h ${DIR}/expected
+echo -n "here-documents: "; time_it here.kaem
+cmp -s ${DIR}/out/gen0.h ${DIR}/expected || { echo "here-document went wrong" ; exit 1 ; }
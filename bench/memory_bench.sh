@@ -0,0 +1,39 @@
+#!/bin/bash
+# Copyright (C) 2020 fosslinux
+# This file is part of mescc-tools.
+#
+# mescc-tools is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# mescc-tools is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with mescc-tools.  If not, see <http://www.gnu.org/licenses/>.
+
+# Memory use as the script grows. A script read from a pipe is run one
+# line at a time, so with everything a line needs coming from the line
+# arena its peak should not move between 10k and 100k lines. A script on
+# disk is compiled whole first, so there it grows with the script.
+
+DIR=$(mktemp -d)
+trap 'rm -rf ${DIR}' EXIT
+
+for LINES in 10000 100000 ; do
+	i=0
+	while [ $i -lt $LINES ] ; do
+		echo "cd \${STAGE_$i:-.}"
+		i=$((i + 1))
+	done > ${DIR}/script$LINES.kaem
+done
+
+for LINES in 10000 100000 ; do
+	echo "== $LINES lines, streamed"
+	cat ${DIR}/script$LINES.kaem | bin/kaem --stats -f /dev/stdin || exit 1
+	echo "== $LINES lines, from file"
+	bin/kaem --stats -f ${DIR}/script$LINES.kaem || exit 1
+done
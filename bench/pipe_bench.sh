@@ -0,0 +1,49 @@
+#!/bin/bash
+# Copyright (C) 2020 fosslinux
+# This file is part of mescc-tools.
+#
+# mescc-tools is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# mescc-tools is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with mescc-tools.  If not, see <http://www.gnu.org/licenses/>.
+
+# A 256 MB file through a pipeline into wc -c: the old way, with sh -c
+# running the whole thing; as a kaem pipeline with the real cat
+# (--no-builtins); and with kaem doing the cat itself, sending the file
+# into the pipe within the kernel. Give the size in MB to try another.
+
+MB=${1:-256}
+DIR=$(mktemp -d)
+trap 'rm -rf ${DIR}' EXIT
+head -c $((MB * 1024 * 1024)) /dev/urandom > ${DIR}/in
+
+echo "sh -c \"cat \${DIR}/in | wc -c\" > \${DIR}/count" > ${DIR}/sh.kaem
+echo "cat \${DIR}/in | wc -c > \${DIR}/count" > ${DIR}/pipe.kaem
+
+# The best of three
+time_it()
+{
+	local best=
+	for run in 1 2 3 ; do
+		rm -f ${DIR}/count
+		local start=$(date +%s%N)
+		DIR=${DIR} bin/kaem "$@" || exit 1
+		local ms=$(( ($(date +%s%N) - start) / 1000000 + 1 ))
+		[ "$(cat ${DIR}/count)" = "$((MB * 1024 * 1024))" ] || { echo "wc -c went wrong" ; exit 1 ; }
+		if [ -z "$best" ] || [ $ms -lt $best ] ; then best=$ms ; fi
+	done
+	echo "$best ms, $(( MB * 1000 / best )) MB/s"
+}
+
+echo "== ${MB} MB through cat | wc -c"
+echo -n "sh -c:         "; time_it -f ${DIR}/sh.kaem
+echo -n "--no-builtins: "; time_it --no-builtins -f ${DIR}/pipe.kaem
+echo -n "builtins:      "; time_it -f ${DIR}/pipe.kaem
@@ -0,0 +1,147 @@
+/* Copyright (C) 2020 fosslinux
+ * This file is part of mescc-tools.
+ *
+ * mescc-tools is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mescc-tools is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mescc-tools.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Microbenchmark for the tokenizer scanning kernels in scan.c.
+ * Walks a generated script the way collect_token() does, once with a
+ * per character if/else chain (the way kaem used to) and once with
+ * scan_token()/scan_char(), and reports bytes per second for each.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+int scan_token(char* buffer, int position, int length);
+int scan_char(char* buffer, int position, int length, int c);
+
+#define SIZE (64 * 1024 * 1024)
+
+/* Number of delimiters seen; keeps the walks from being optimized away */
+long found;
+
+void walk_bytes(char* buffer, int length)
+{
+	int i = 0;
+	char c;
+	while(i < length)
+	{
+		c = buffer[i];
+		i = i + 1;
+		if((' ' == c) || ('\t' == c) || ('\n' == c) || ('"' == c) || ('\\' == c) || (0 == c))
+		{
+			found = found + 1;
+		}
+		else if('#' == c)
+		{ /* Comment, to the end of the line */
+			while((i < length) && ('\n' != buffer[i])) i = i + 1;
+			found = found + 1;
+		}
+	}
+}
+
+void walk_kernel(char* buffer, int length)
+{
+	int i = 0;
+	while(i < length)
+	{
+		i = scan_token(buffer, i, length);
+		if(i >= length) break;
+		if('#' == buffer[i]) i = scan_char(buffer, i, length, '\n');
+		found = found + 1;
+		i = i + 1;
+	}
+}
+
+/* Fill buffer with lines made of words of word_length, comment_every nth line a comment */
+void generate(char* buffer, int word_length, int words, int comment_every)
+{
+	int i = 0;
+	int line = 0;
+	int w;
+	int j;
+	while(i < SIZE - (words * (word_length + 1)) - 2)
+	{
+		if((0 != comment_every) && (0 != (line % comment_every)))
+		{
+			buffer[i] = '#';
+			i = i + 1;
+		}
+		for(w = 0; w < words; w = w + 1)
+		{
+			for(j = 0; j < word_length; j = j + 1)
+			{
+				buffer[i] = 'a' + ((i + j) % 26);
+				i = i + 1;
+			}
+			buffer[i] = ' ';
+			i = i + 1;
+		}
+		buffer[i] = '\n';
+		i = i + 1;
+		line = line + 1;
+	}
+	while(i < SIZE)
+	{
+		buffer[i] = '\n';
+		i = i + 1;
+	}
+}
+
+double seconds(void)
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + (t.tv_nsec / 1e9);
+}
+
+void run(char* name, char* buffer)
+{
+	double start;
+	double bytes_time;
+	double kernel_time;
+	int round;
+
+	start = seconds();
+	for(round = 0; round < 4; round = round + 1) walk_bytes(buffer, SIZE);
+	bytes_time = seconds() - start;
+
+	start = seconds();
+	for(round = 0; round < 4; round = round + 1) walk_kernel(buffer, SIZE);
+	kernel_time = seconds() - start;
+
+	printf("%-28s byte loop %8.1f MB/s   kernel %8.1f MB/s   (%.1fx)\n", name,
+	       4.0 * SIZE / bytes_time / 1e6, 4.0 * SIZE / kernel_time / 1e6,
+	       bytes_time / kernel_time);
+}
+
+int main(void)
+{
+	char* buffer = malloc(SIZE);
+	if(NULL == buffer) return EXIT_FAILURE;
+
+	generate(buffer, 6, 8, 0);
+	run("short words", buffer);
+	generate(buffer, 200, 40, 0);
+	run("long lines", buffer);
+	generate(buffer, 8, 10, 10);
+	run("comment heavy (90%)", buffer);
+
+	printf("(%ld delimiters)\n", found);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,52 @@
+#!/bin/bash
+# Copyright (C) 2020 fosslinux
+# This file is part of mescc-tools.
+#
+# mescc-tools is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# mescc-tools is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with mescc-tools.  If not, see <http://www.gnu.org/licenses/>.
+
+# Hashing and checking a stage's outputs: 200 files of 1 MB and one of
+# 256 MB, with sha256sum and sha256sum -c done by kaem itself (SHA-NI
+# where the CPU has it, one file per CPU at once) and with --no-builtins
+# by the real program.
+
+DIR=$(mktemp -d)
+trap 'rm -rf ${DIR}' EXIT
+
+mkdir ${DIR}/out
+i=0
+while [ $i -lt 200 ] ; do
+	head -c 1048576 /dev/urandom > ${DIR}/out/file$i
+	i=$((i + 1))
+done
+head -c 268435456 /dev/urandom > ${DIR}/out/large
+(cd ${DIR}/out && sha256sum * > ${DIR}/manifest)
+
+echo "cd ${DIR}/out" > ${DIR}/hash.kaem
+echo "sha256sum $(cd ${DIR}/out && echo *)" >> ${DIR}/hash.kaem
+echo "cd ${DIR}/out" > ${DIR}/check.kaem
+echo "sha256sum -c ${DIR}/manifest" >> ${DIR}/check.kaem
+
+time_it()
+{
+	local start=$(date +%s%N)
+	bin/kaem "$@" > /dev/null || exit 1
+	echo "$(( ($(date +%s%N) - start) / 1000000 )) ms"
+}
+
+for run in 1 2 3 ; do
+	echo -n "sha256sum, builtin:         "; time_it -f ${DIR}/hash.kaem
+	echo -n "sha256sum, --no-builtins:   "; time_it --no-builtins -f ${DIR}/hash.kaem
+	echo -n "sha256sum -c, builtin:       "; time_it -f ${DIR}/check.kaem
+	echo -n "sha256sum -c, --no-builtins: "; time_it --no-builtins -f ${DIR}/check.kaem
+done
@@ -0,0 +1,103 @@
+/* Copyright (C) 2020 fosslinux
+ * This file is part of mescc-tools.
+ *
+ * mescc-tools is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mescc-tools is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mescc-tools.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Microbenchmark for starting programs. Grows the heap to a series of
+ * sizes, touching every page the way a long running kaem does, and at
+ * each one times running /bin/true with fork() and execve() (the
+ * M2-Planet fallback) and with spawn() from platform.c.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "../kaem.h"
+
+#define RUNS 300
+
+char* program = "/bin/true";
+char* args[] = {"true", NULL};
+char* no_env[] = {NULL};
+
+double seconds(void)
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + (t.tv_nsec / 1e9);
+}
+
+int fork_run(void)
+{
+	int status;
+	int f = fork();
+	if(-1 == f) return -1;
+	if(0 == f)
+	{
+		execve(program, args, no_env);
+		_exit(EXIT_FAILURE);
+	}
+	waitpid(f, &status, 0);
+	return status;
+}
+
+int spawn_run(void)
+{
+	int status;
+	int f = spawn(program, args, no_env);
+	if(-1 == f) return -1;
+	waitpid(f, &status, 0);
+	return status;
+}
+
+double rate(int (*run)(void))
+{
+	int i;
+	double start = seconds();
+	for(i = 0; i < RUNS; i = i + 1)
+	{
+		if(0 != run()) exit(EXIT_FAILURE);
+	}
+	return RUNS / (seconds() - start);
+}
+
+int main(void)
+{
+	int sizes[] = {0, 64, 256, 1024};
+	int i;
+	long grow;
+	char* heap;
+	for(i = 0; i < 4; i = i + 1)
+	{
+		if(0 != sizes[i])
+		{ /* Never freed; kaem's heap does not shrink either */
+			grow = (sizes[i] - sizes[i - 1]) * 1024L * 1024L;
+			heap = malloc(grow);
+			if(NULL == heap)
+			{
+				printf("%5d MB heap: could not allocate\n", sizes[i]);
+				break;
+			}
+			memset(heap, 1, grow);
+		}
+		printf("%5d MB heap   fork %8.0f spawns/s   spawn %8.0f spawns/s\n", sizes[i], rate(fork_run), rate(spawn_run));
+		fflush(stdout);
+	}
+	return EXIT_SUCCESS;
+}
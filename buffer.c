@@ -0,0 +1,87 @@
+/* Copyright (C) 2020 fosslinux
+ * This file is part of mescc-tools.
+ *
+ * mescc-tools is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mescc-tools is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mescc-tools.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * BUFFERS
+ * Strings that grow as they are written to. A buffer knows its own length,
+ * so adding to it never has to walk what is already there, and it only
+ * ever takes about as much memory as it has needed. Storage comes from an
+ * arena, so a buffer lives exactly as long as the arena it was made from.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include "kaem.h"
+
+struct Buffer* buffer_new(struct Arena* a, int capacity)
+{
+	struct Buffer* b = arena_calloc(a, 1, sizeof(struct Buffer));
+	b->arena = a;
+	/* Always room for the terminating NUL */
+	b->capacity = capacity + 1;
+	b->text = arena_calloc(a, b->capacity, sizeof(char));
+	return b;
+}
+
+/* Make sure there is room for extra more characters */
+void buffer_reserve(struct Buffer* b, int extra)
+{
+	char* grown;
+	int i;
+	if(b->length + extra < b->capacity) return;
+	/* Double it; there is no realloc() under M2-Planet */
+	b->capacity = (b->capacity * 2) + extra;
+	grown = arena_calloc(b->arena, b->capacity, sizeof(char));
+	for(i = 0; i < b->length; i = i + 1)
+	{
+		grown[i] = b->text[i];
+	}
+	b->text = grown;
+}
+
+void buffer_add_char(struct Buffer* b, int c)
+{
+	buffer_reserve(b, 1);
+	b->text[b->length] = c;
+	b->length = b->length + 1;
+	b->text[b->length] = 0;
+}
+
+/* Add the first length characters of s */
+void buffer_add_range(struct Buffer* b, char* s, int length)
+{
+	int i;
+	buffer_reserve(b, length);
+	for(i = 0; i < length; i = i + 1)
+	{
+		b->text[b->length + i] = s[i];
+	}
+	b->length = b->length + length;
+	b->text[b->length] = 0;
+}
+
+void buffer_add_string(struct Buffer* b, char* s)
+{
+	buffer_add_range(b, s, string_length(s));
+}
+
+/* Empty the buffer, keeping its memory */
+void buffer_clear(struct Buffer* b)
+{
+	b->length = 0;
+	b->text[0] = 0;
+}
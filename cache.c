@@ -0,0 +1,373 @@
+/* Copyright (C) 2020 fosslinux
+ * This file is part of mescc-tools.
+ *
+ * mescc-tools is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mescc-tools is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mescc-tools.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * CACHE OF COMPILED SCRIPTS
+ * With --cache-dir, a compiled script is saved in that directory under
+ * the SHA-256 of kaem's version and the script's contents. Next time the
+ * same script is run the file is mapped back in and used as it is: the
+ * tokens point straight into it, so nothing has to be tokenized.
+ *
+ * The file is little endian 32 bit words:
+ *   magic "kaemIR" plus two bytes of format version
+ *   length of the whole file
+ *   checksum of everything after the header
+ *   number of commands
+ *   offset of the string table
+ * then for each command: kind, builtin, background, number of tokens,
+ * and for each token: its offset in the string table and number of
+ * segments, and for each segment: type, offset of its text, offset of its
+ * alternative + 1 (0 for none). After the tokens, the number of
+ * redirections, and for each: fd, mode, and its target as for a token.
+ * Last of all 1 if it is piped into another command, which follows in
+ * the same way, or 0 if not.
+ * The string table is NUL terminated strings, back to back.
+ *
+ * Anything that does not add up means the file is ignored and the script
+ * is compiled again, as if there had been no cache.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include "kaem.h"
+
+#define CACHE_HEADER 24
+//CONSTANT CACHE_HEADER 24
+
+/* Prototypes from other files */
+int string_length(char* a);
+
+/* The file name for a script in the cache; must be called before it is tokenized */
+char* cache_path(struct Script* s)
+{
+	struct SHA256* c = sha256_init();
+	sha256_string(c, "kaemIR10 kaem version ");
+	sha256_string(c, VERSION);
+	sha256_string(c, "\n");
+	sha256_update(c, s->buffer, s->length);
+	return prepend_string(CACHE_DIR, prepend_string("/", prepend_string(sha256_hex(c), ".kaemc")));
+}
+
+/*
+ * Cheap checksum, to catch files damaged on disk. This is Adler-32, with
+ * the modulo only taken every so often; 3800 bytes is as many as can be
+ * summed before b could overflow a signed 32 bit int.
+ */
+int cache_checksum(char* buffer, int start, int length)
+{
+	int a = 1;
+	int b = 0;
+	int i = start;
+	int end;
+	while(i < length)
+	{
+		end = i + 3800;
+		if(end > length) end = length;
+		while(i < end)
+		{
+			a = a + (buffer[i] & 0xFF);
+			b = b + a;
+			i = i + 1;
+		}
+		a = a % 65521;
+		b = b % 65521;
+	}
+	return (b << 15) ^ a;
+}
+
+/*
+ * WRITING
+ */
+
+void cache_put_word(struct Script* out, int w)
+{
+	script_append(out, w & 0xFF);
+	script_append(out, (w >> 8) & 0xFF);
+	script_append(out, (w >> 16) & 0xFF);
+	script_append(out, (w >> 24) & 0xFF);
+}
+
+void cache_set_word(struct Script* out, int at, int w)
+{
+	out->buffer[at] = w & 0xFF;
+	out->buffer[at + 1] = (w >> 8) & 0xFF;
+	out->buffer[at + 2] = (w >> 16) & 0xFF;
+	out->buffer[at + 3] = (w >> 24) & 0xFF;
+}
+
+/* Add a string to the string table, returning its offset */
+int cache_put_string(struct Script* strings, char* s)
+{
+	int offset = strings->length;
+	while(0 != s[0])
+	{
+		script_append(strings, s[0]);
+		s = s + 1;
+	}
+	script_append(strings, 0);
+	return offset;
+}
+
+/* A token's segments: how many, and each one */
+void cache_put_segments(struct Script* out, struct Script* strings, struct Segment* head)
+{
+	struct Segment* s;
+	int segments = 0;
+	for(s = head; NULL != s; s = s->next) segments = segments + 1;
+	cache_put_word(out, segments);
+	for(s = head; NULL != s; s = s->next)
+	{
+		cache_put_word(out, s->type);
+		cache_put_word(out, cache_put_string(strings, s->text));
+		if(NULL == s->alternative) cache_put_word(out, 0);
+		else cache_put_word(out, cache_put_string(strings, s->alternative) + 1);
+	}
+}
+
+/* A command, then the rest of its pipeline if there is one */
+void cache_put_command(struct Script* out, struct Script* strings, struct Command* c)
+{
+	struct Redirect* r;
+	int j;
+	int redirects;
+	cache_put_word(out, c->kind);
+	cache_put_word(out, c->builtin);
+	cache_put_word(out, c->background);
+	cache_put_word(out, c->count);
+	for(j = 0; j < c->count; j = j + 1)
+	{
+		cache_put_word(out, cache_put_string(strings, c->tokens[j]));
+		cache_put_segments(out, strings, c->segments[j]);
+	}
+	redirects = redirect_count(c->redirects);
+	cache_put_word(out, redirects);
+	for(r = c->redirects; NULL != r; r = r->next)
+	{
+		cache_put_word(out, r->fd);
+		cache_put_word(out, r->mode);
+		cache_put_word(out, cache_put_string(strings, r->target));
+		cache_put_segments(out, strings, r->segments);
+	}
+	if(NULL == c->pipe)
+	{
+		cache_put_word(out, FALSE);
+		return;
+	}
+	cache_put_word(out, TRUE);
+	cache_put_command(out, strings, c->pipe);
+}
+
+/* Save a compiled script to the cache; failing to is not an error */
+void cache_store(char* path, struct Program* p)
+{
+	struct Script* out = calloc(1, sizeof(struct Script));
+	struct Script* strings = calloc(1, sizeof(struct Script));
+	require((out != NULL) && (strings != NULL), "Memory initialization of cache buffers failed\n");
+	int i;
+
+	char* magic = "kaemIR10";
+	for(i = 0; i < 8; i = i + 1) script_append(out, magic[i]);
+	/* Filled in below */
+	for(i = 8; i < CACHE_HEADER; i = i + 1) script_append(out, 0);
+
+	for(i = 0; i < p->count; i = i + 1) cache_put_command(out, strings, p->commands[i]);
+
+	int table = out->length;
+	for(i = 0; i < strings->length; i = i + 1) script_append(out, strings->buffer[i]);
+
+	cache_set_word(out, 8, out->length);
+	cache_set_word(out, 12, cache_checksum(out->buffer, CACHE_HEADER, out->length));
+	cache_set_word(out, 16, p->count);
+	cache_set_word(out, 20, table);
+
+	/* Written to the side and moved into place, so nobody sees half a file */
+	char* temp = temp_name(path);
+	if(FALSE == write_file(temp, out->buffer, out->length)) return;
+	if(FALSE == replace_file(temp, path))
+	{
+		if(WARNINGS)
+		{
+			file_print("WARNING: unable to save ", stderr);
+			file_print(path, stderr);
+			file_print(" to the cache\n", stderr);
+		}
+	}
+}
+
+/*
+ * READING
+ */
+
+/* Read the word at in->position, moving past it; -1 if there is none before limit */
+int cache_get_word(struct Script* in, int limit)
+{
+	int at = in->position;
+	if(at + 4 > limit) return -1;
+	/* Nothing valid is anywhere near as big as 2^31 */
+	if(0 != (in->buffer[at + 3] & 0x80)) return -1;
+	in->position = at + 4;
+	return (in->buffer[at] & 0xFF) | ((in->buffer[at + 1] & 0xFF) << 8) | ((in->buffer[at + 2] & 0xFF) << 16) | ((in->buffer[at + 3] & 0xFF) << 24);
+}
+
+/* The string at offset in the string table; NULL if offset is not in it */
+char* cache_get_string(struct Script* in, int table, int offset)
+{
+	if((0 > offset) || (table + offset >= in->length)) return NULL;
+	return in->buffer + table + offset;
+}
+
+/* Set when what cache_get_segments() read doesn't add up */
+int cache_broken;
+
+/* Read back what cache_put_segments() wrote; NULL for none (or if it is broken) */
+struct Segment* cache_get_segments(struct Script* in, int table)
+{
+	struct Segment* head = NULL;
+	struct Segment* tail = NULL;
+	struct Segment* s;
+	int alternative;
+	int k;
+	int segments = cache_get_word(in, table);
+	cache_broken = TRUE;
+	if((0 > segments) || ((segments * 12) > (table - in->position))) return NULL;
+	for(k = 0; k < segments; k = k + 1)
+	{
+		s = calloc(1, sizeof(struct Segment));
+		require(s != NULL, "Memory initialization of segment failed\n");
+		s->type = cache_get_word(in, table);
+		if((0 > s->type) || (SEGMENT_ALL < s->type)) return NULL;
+		s->text = cache_get_string(in, table, cache_get_word(in, table));
+		if(NULL == s->text) return NULL;
+		alternative = cache_get_word(in, table);
+		if(0 > alternative) return NULL;
+		if(0 != alternative)
+		{
+			s->alternative = cache_get_string(in, table, alternative - 1);
+			if(NULL == s->alternative) return NULL;
+		}
+		if(NULL == tail) head = s;
+		else tail->next = s;
+		tail = s;
+	}
+	cache_broken = FALSE;
+	return head;
+}
+
+/* The command cache_get_command() read is piped into the one after it */
+int cache_piped;
+
+/* Read back one command of what cache_put_command() wrote; NULL if it doesn't add up */
+struct Command* cache_get_command(struct Script* in, int table)
+{
+	struct Command* c = calloc(1, sizeof(struct Command));
+	require(c != NULL, "Memory initialization of command failed\n");
+	struct Redirect* r;
+	struct Redirect* last = NULL;
+	int j;
+	int redirects;
+	c->kind = cache_get_word(in, table);
+	c->builtin = cache_get_word(in, table);
+	c->background = cache_get_word(in, table);
+	c->count = cache_get_word(in, table);
+	/* Every token takes at least 8 bytes */
+	if((0 >= c->count) || ((c->count * 8) > (table - in->position))) return NULL;
+	if((0 > c->kind) || (COMMAND_DECLARE < c->kind) || (0 > c->builtin)) return NULL;
+	if((FALSE != c->background) && (TRUE != c->background)) return NULL;
+	c->capacity = c->count;
+	c->tokens = calloc(c->count, sizeof(char*));
+	c->segments = calloc(c->count, sizeof(struct Segment*));
+	require((c->tokens != NULL) && (c->segments != NULL), "Memory initialization of command failed\n");
+	for(j = 0; j < c->count; j = j + 1)
+	{
+		c->tokens[j] = cache_get_string(in, table, cache_get_word(in, table));
+		if(NULL == c->tokens[j]) return NULL;
+		c->segments[j] = cache_get_segments(in, table);
+		if(cache_broken) return NULL;
+	}
+	redirects = cache_get_word(in, table);
+	if((0 > redirects) || ((redirects * 16) > (table - in->position))) return NULL;
+	for(j = 0; j < redirects; j = j + 1)
+	{
+		r = calloc(1, sizeof(struct Redirect));
+		require(r != NULL, "Memory initialization of redirection failed\n");
+		r->fd = cache_get_word(in, table);
+		r->mode = cache_get_word(in, table);
+		if((0 > r->fd) || (9 < r->fd) || (0 > r->mode) || (REDIRECT_HERE < r->mode)) return NULL;
+		r->target = cache_get_string(in, table, cache_get_word(in, table));
+		if(NULL == r->target) return NULL;
+		r->segments = cache_get_segments(in, table);
+		if(cache_broken) return NULL;
+		if(NULL == last) c->redirects = r;
+		else last->next = r;
+		last = r;
+	}
+	cache_piped = cache_get_word(in, table);
+	if((FALSE != cache_piped) && (TRUE != cache_piped)) return NULL;
+	return c;
+}
+
+/* Load a compiled script from the cache; NULL if it isn't there or can't be trusted */
+struct Program* cache_load(char* path)
+{
+	FILE* f = fopen(path, "r");
+	if(NULL == f) return NULL;
+	struct Script* in = calloc(1, sizeof(struct Script));
+	require(in != NULL, "Memory initialization of cache file failed\n");
+	int loaded = load_script(in, f);
+	fclose(f);
+	if(FALSE == loaded) return NULL;
+
+	/* Check the header */
+	if(in->length < CACHE_HEADER) return NULL;
+	char* magic = "kaemIR10";
+	int i;
+	for(i = 0; i < 8; i = i + 1)
+	{
+		if(magic[i] != in->buffer[i]) return NULL;
+	}
+	in->position = 8;
+	if(in->length != cache_get_word(in, CACHE_HEADER)) return NULL;
+	if(cache_checksum(in->buffer, CACHE_HEADER, in->length) != cache_get_word(in, CACHE_HEADER)) return NULL;
+	int count = cache_get_word(in, CACHE_HEADER);
+	int table = cache_get_word(in, CACHE_HEADER);
+	if((0 > count) || (CACHE_HEADER > table) || (table > in->length)) return NULL;
+	/* The string table must finish with the end of a string */
+	if((table < in->length) && (0 != in->buffer[in->length - 1])) return NULL;
+
+	struct Program* p = calloc(1, sizeof(struct Program));
+	require(p != NULL, "Memory initialization of program failed\n");
+	p->commands = calloc(count + 1, sizeof(struct Command*));
+	require(p->commands != NULL, "Memory initialization of program failed\n");
+	struct Command* c;
+	for(i = 0; i < count; i = i + 1)
+	{
+		c = cache_get_command(in, table);
+		if(NULL == c) return NULL;
+		p->commands[i] = c;
+		while(cache_piped)
+		{ /* The rest of its pipeline */
+			c->pipe = cache_get_command(in, table);
+			if(NULL == c->pipe) return NULL;
+			c = c->pipe;
+		}
+	}
+	/* Every word should have been used */
+	if(in->position != table) return NULL;
+	p->count = count;
+	p->capacity = count + 1;
+	return p;
+}
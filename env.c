@@ -0,0 +1,264 @@
+/* Copyright (C) 2020 fosslinux
+ * This file is part of mescc-tools.
+ *
+ * mescc-tools is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mescc-tools is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mescc-tools.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * ENVIRONMENT
+ * The variables are kept in an open addressing hash table (linear
+ * probing) keyed on their name, so looking one up, setting it or
+ * unsetting it takes the same time however many there are. They are also
+ * chained together in the order they were first set, so that the
+ * environment handed to programs always comes out in the same order.
+ *
+ * Unsetting a variable takes it out of the chain but leaves it in its
+ * slot, marked removed, so that probing for the names after it still
+ * works. Removed slots are dropped when the table is next rebuilt.
+ *
+ * Every variable is kept as a NAME=value string, with name and value
+ * pointing into it, so the envp handed to execve() is just an array of
+ * those. It is built once and then reused by every command until a
+ * variable is changed.
+ *
+ * The environment kaem was started with is not copied. Nothing is done
+ * with it until the env is first used, and then each variable just
+ * points into its NAME=value string from envp; a variable only gets
+ * memory of its own once it is set to something else.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include "kaem.h"
+
+/* A string hash; djb2, kept to 31 bits so that it is the same everywhere */
+int env_hash(char* name, int length)
+{
+	unsigned h = 5381;
+	int i;
+	for(i = 0; i < length; i = i + 1)
+	{
+		h = ((h * 33) + (name[i] & 0xFF)) & 0x7FFFFFFF;
+	}
+	return h;
+}
+
+/* capacity must be a power of two */
+struct Environment* env_new(int capacity)
+{
+	struct Environment* e = arena_calloc(long_arena, 1, sizeof(struct Environment));
+	e->capacity = capacity;
+	e->slots = arena_calloc(long_arena, capacity, sizeof(struct Variable*));
+	e->arena = arena_new(4096);
+	return e;
+}
+
+/* Is v called the first length characters of name */
+int env_is_named(struct Variable* v, char* name, int length)
+{
+	int i;
+	if(length != v->name_length) return FALSE;
+	for(i = 0; i < length; i = i + 1)
+	{
+		if(name[i] != v->name[i]) return FALSE;
+	}
+	return TRUE;
+}
+
+/* The slot holding name, or the empty slot where it would go */
+int env_slot(struct Environment* e, char* name, int length, int hash)
+{
+	int mask = e->capacity - 1;
+	int i = hash & mask;
+	struct Variable* v = e->slots[i];
+	while(NULL != v)
+	{
+		if((FALSE == v->removed) && (hash == v->hash) && env_is_named(v, name, length)) return i;
+		i = (i + 1) & mask;
+		v = e->slots[i];
+	}
+	return i;
+}
+
+/* Rebuild the table, big enough for what is in it, without the removed */
+void env_rehash(struct Environment* e)
+{
+	int capacity = e->capacity;
+	/* Only grow when it is the variables themselves that fill it */
+	while((e->count * 2) >= capacity) capacity = capacity * 2;
+	e->capacity = capacity;
+	e->slots = arena_calloc(long_arena, capacity, sizeof(struct Variable*));
+	e->used = 0;
+	struct Variable* v;
+	for(v = e->first; NULL != v; v = v->next)
+	{
+		e->slots[env_slot(e, v->name, v->name_length, v->hash)] = v;
+		e->used = e->used + 1;
+	}
+}
+
+/* Put a new variable on the end of the env, in slot i */
+void env_insert(struct Environment* e, struct Variable* v, int i)
+{
+	v->prev = e->last;
+	if(NULL == e->last) e->first = v;
+	else e->last->next = v;
+	e->last = v;
+	e->count = e->count + 1;
+
+	e->slots[i] = v;
+	e->used = e->used + 1;
+	/* Keep at least a quarter of the slots empty, so probes stay short */
+	if((e->used * 4) >= (e->capacity * 3)) env_rehash(e);
+}
+
+/* Bring in the variables from envp, the first time the env is used */
+void env_import(struct Environment* e)
+{
+	char** envp = e->imported;
+	struct Variable* v;
+	int hash;
+	int slot;
+	int i;
+	int j;
+	e->imported = NULL;
+	for(i = 0; NULL != envp[i]; i = i + 1)
+	{
+		/* Split NAME=value at the first = */
+		j = 0;
+		while((0 != envp[i][j]) && ('=' != envp[i][j])) j = j + 1;
+		/* If we get strange input, we need to ignore it */
+		if(0 == envp[i][j]) continue;
+		hash = env_hash(envp[i], j);
+		slot = env_slot(e, envp[i], j, hash);
+		/* The first of a name wins, as with getenv() */
+		if(NULL != e->slots[slot]) continue;
+
+		v = arena_calloc(long_arena, 1, sizeof(struct Variable));
+		v->entry = envp[i];
+		v->name = envp[i];
+		v->name_length = j;
+		v->value = envp[i] + j + 1;
+		v->hash = hash;
+		env_insert(e, v, slot);
+	}
+}
+
+/* The variable called name; NULL when it is not set */
+struct Variable* env_find(char* name)
+{
+	if(NULL != env->imported) env_import(env);
+	int length = string_length(name);
+	return env->slots[env_slot(env, name, length, env_hash(name, length))];
+}
+
+/* Search for a variable in the env; NULL when it is not set */
+char* env_lookup(char* variable)
+{
+	struct Variable* v = env_find(variable);
+	if(NULL == v) return NULL;
+	return v->value;
+}
+
+/* Give v a NAME=value string of its own, with room for a value of length */
+void env_new_entry(struct Variable* v, char* name, int length)
+{
+	int i;
+	v->capacity = length;
+	v->entry = arena_calloc(long_arena, v->name_length + length + 2, sizeof(char));
+	for(i = 0; i < v->name_length; i = i + 1) v->entry[i] = name[i];
+	v->entry[i] = '=';
+	v->name = v->entry;
+	v->value = v->entry + i + 1;
+}
+
+/* Set a variable, replacing its value where it stands if it is already set */
+void env_set(char* name, char* value)
+{
+	if(NULL != env->imported) env_import(env);
+	int name_length = string_length(name);
+	int hash = env_hash(name, name_length);
+	int i = env_slot(env, name, name_length, hash);
+	struct Variable* v = env->slots[i];
+	char* hold;
+	int length = string_length(value);
+	if(NULL != v)
+	{
+		/* Nothing changes, so neither does the envp */
+		if(match(value, v->value)) return;
+		/* Reuse the memory the old value had when it is ours and the new one fits */
+		if(length > v->capacity) env_new_entry(v, v->name, length);
+	}
+	else
+	{
+		v = arena_calloc(long_arena, 1, sizeof(struct Variable));
+		v->name_length = name_length;
+		v->hash = hash;
+		env_new_entry(v, name, length);
+		env_insert(env, v, i);
+	}
+	hold = copy_string(v->value, value);
+	hold[0] = 0;
+	env->dirty = TRUE;
+}
+
+/* Unset a variable; nothing happens if it was not set */
+void env_unset(char* name)
+{
+	struct Variable* v = env_find(name);
+	if(NULL == v) return;
+	v->removed = TRUE;
+	if(NULL == v->prev) env->first = v->next;
+	else v->prev->next = v->next;
+	if(NULL == v->next) env->last = v->prev;
+	else v->next->prev = v->prev;
+	env->count = env->count - 1;
+	env->dirty = TRUE;
+}
+
+/*
+ * The env as NAME=value strings, in the order they were set, ready for
+ * execve(). Only rebuilt when something has changed since last time.
+ */
+char** env_array()
+{
+	if(NULL != env->imported) env_import(env);
+	if((NULL != env->array) && (FALSE == env->dirty)) return env->array;
+
+	/* The old array is finished with */
+	arena_reset(env->arena);
+	env->array = arena_calloc(env->arena, env->count + 1, sizeof(char*));
+	struct Variable* v;
+	int index = 0;
+	for(v = env->first; NULL != v; v = v->next)
+	{
+		env->array[index] = v->entry;
+		index = index + 1;
+	}
+	env->dirty = FALSE;
+	env->generation = env->generation + 1;
+	return env->array;
+}
+
+/* Function to populate env; the work is put off until it is needed */
+void populate_env(char** envp)
+{
+	int count = 0;
+	int capacity = env->capacity;
+	while(NULL != envp[count]) count = count + 1;
+	/* Big enough that importing never has to rebuild it */
+	while((count * 2) >= capacity) capacity = capacity * 2;
+	if(capacity != env->capacity) env = env_new(capacity);
+	env->imported = envp;
+}
@@ -17,10 +17,9 @@
 
 #include<stdlib.h>
 #include<stdio.h>
-#define MAX_STRING 4096
-//CONSTANT MAX_STRING 4096
 // void* calloc(int count, int size);
 void file_print(char* s, FILE* f);
+int string_length(char* a);
 
 char* copy_string(char* target, char* source)
 {
@@ -35,7 +34,7 @@ char* copy_string(char* target, char* source)
 
 char* postpend_char(char* s, char a)
 {
-	char* ret = calloc(MAX_STRING, sizeof(char));
+	char* ret = calloc(string_length(s) + 2, sizeof(char));
 	if(NULL == ret)
 	{
 		file_print("calloc failed in postpend_char\n", stderr);
@@ -48,7 +47,7 @@ char* postpend_char(char* s, char a)
 
 char* prepend_char(char a, char* s)
 {
-	char* ret = calloc(MAX_STRING, sizeof(char));
+	char* ret = calloc(string_length(s) + 2, sizeof(char));
 	if(NULL == ret)
 	{
 		file_print("calloc failed in prepend_char\n", stderr);
@@ -61,7 +60,7 @@ char* prepend_char(char a, char* s)
 
 char* prepend_string(char* add, char* base)
 {
-	char* ret = calloc(MAX_STRING, sizeof(char));
+	char* ret = calloc(string_length(add) + string_length(base) + 1, sizeof(char));
 	if(NULL == ret)
 	{
 		file_print("calloc failed in prepend_string\n", stderr);
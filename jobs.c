@@ -0,0 +1,147 @@
+/* Copyright (C) 2020 fosslinux
+ * This file is part of mescc-tools.
+ *
+ * mescc-tools is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mescc-tools is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mescc-tools.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * JOBS
+ * Commands started with & run while kaem carries on with the script.
+ * Children are reaped with waitpid(-1), whichever finishes first, so
+ * waiting on one command also collects any background jobs that end in
+ * the meantime; nothing ever blocks on one particular child while others
+ * sit unreaped. A job stays on the list until it has been waited for.
+ * The commands of a pipeline are on it too, for as long as they run.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <sys/wait.h>
+#include "kaem.h"
+
+/* Keep track of pid, so that whenever it finishes its status is kept */
+struct Job* job_add(int pid)
+{
+	struct Job* j = calloc(1, sizeof(struct Job));
+	require(j != NULL, "Memory initialization of job failed\n");
+	j->pid = pid;
+	/* Jobs are kept in the order they were started */
+	if(NULL == jobs) jobs = j;
+	else
+	{
+		struct Job* last = jobs;
+		while(NULL != last->next) last = last->next;
+		last->next = j;
+	}
+	return j;
+}
+
+/* Note that pid is running in the background */
+void job_start(int pid)
+{
+	job_add(pid);
+	LAST_JOB = numerate_number(pid);
+}
+
+struct Job* job_find(int pid)
+{
+	struct Job* j;
+	for(j = jobs; NULL != j; j = j->next)
+	{
+		if(pid == j->pid) return j;
+	}
+	return NULL;
+}
+
+/* Wait for any child to finish and record it; the pid, or -1 for none left */
+int job_reap(int* status)
+{
+	int pid = waitpid(-1, status, 0);
+	if(0 >= pid) return -1;
+	struct Job* j = job_find(pid);
+	if(NULL != j)
+	{
+		j->status = status[0];
+		j->done = TRUE;
+	}
+	return pid;
+}
+
+/* Wait for a command run in the foreground; returns its wait status */
+int job_wait_for(int pid)
+{
+	int status = 0;
+	int reaped = job_reap(&status);
+	while((pid != reaped) && (-1 != reaped))
+	{
+		reaped = job_reap(&status);
+	}
+	return status;
+}
+
+/* Take a job off the list, once it has been waited for */
+void job_forget(struct Job* j)
+{
+	if(jobs == j)
+	{
+		jobs = j->next;
+		return;
+	}
+	struct Job* before = jobs;
+	while(j != before->next) before = before->next;
+	before->next = j->next;
+}
+
+/* Wait for a job and take it off the list; its wait status */
+int job_collect(struct Job* j)
+{
+	int status = 0;
+	while(FALSE == j->done)
+	{
+		if(-1 == job_reap(&status))
+		{ /* Someone else got it; there is no knowing how it went */
+			j->done = TRUE;
+		}
+	}
+	job_forget(j);
+	return j->status;
+}
+
+/* Wait for a job; TRUE if it failed, which --strict does not put up with */
+int job_finish(struct Job* j)
+{
+	if(0 == job_collect(j)) return FALSE;
+
+	if(STRICT)
+	{
+		file_print("Subprocess error ", stderr);
+		file_print(numerate_number(j->status), stderr);
+		file_print(" from background job ", stderr);
+		file_print(numerate_number(j->pid), stderr);
+		file_print("\nABORTING HARD\n", stderr);
+		exit(EXIT_FAILURE);
+	}
+	return TRUE;
+}
+
+/* Wait for every job; TRUE if any of them failed */
+int job_finish_all()
+{
+	int rc = FALSE;
+	while(NULL != jobs)
+	{
+		if(job_finish(jobs)) rc = TRUE;
+	}
+	return rc;
+}
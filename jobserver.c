@@ -0,0 +1,159 @@
+/* Copyright (C) 2020 fosslinux
+ * This file is part of mescc-tools.
+ *
+ * mescc-tools is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mescc-tools is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mescc-tools.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * JOBSERVER
+ * When kaem is run by a make -j, MAKEFLAGS has --jobserver-auth in it:
+ * either fifo:PATH, or the two fds of a pipe (R,W, also as the older
+ * --jobserver-fds). Each byte in it is a token, and every make (or kaem)
+ * sharing it takes one before running anything beyond the first job it
+ * has going, and puts it back afterwards. With -j, kaem does the same
+ * for the commands it runs side by side, so that -j is only the most it
+ * will run; the jobserver has the last word.
+ *
+ * MAKEFLAGS and the fds are left as they are for children, so a make run
+ * by kaem shares the same tokens. With --jobserver and no jobserver to
+ * join, kaem starts one of its own with -j tokens (one being kaem's own)
+ * and puts it in MAKEFLAGS, so any makes it runs share them too.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include "kaem.h"
+
+/* Where tokens are taken from and put back; -1 for no jobserver */
+int jobserver_read;
+int jobserver_write;
+/* The tokens taken, to be put back as they were */
+int* jobserver_tokens;
+int jobserver_held;
+
+/* The value of the MAKEFLAGS option starting with option; NULL if there is none */
+char* jobserver_option(char* flags, char* option)
+{
+	int length = string_length(option);
+	int start = 0;
+	int end;
+	int i;
+	while(0 != flags[start])
+	{
+		end = start;
+		while((0 != flags[end]) && (' ' != flags[end])) end = end + 1;
+		for(i = 0; i < length; i = i + 1)
+		{
+			if((start + i) >= end) break;
+			if(flags[start + i] != option[i]) break;
+		}
+		if(i == length)
+		{ /* The last one given is the one that counts, as with make */
+			char* value = arena_calloc(long_arena, end - start - length + 1, sizeof(char));
+			for(i = start + length; i < end; i = i + 1) value[i - start - length] = flags[i];
+			char* later = jobserver_option(flags + end, option);
+			if(NULL != later) return later;
+			return value;
+		}
+		start = end;
+		while(' ' == flags[start]) start = start + 1;
+	}
+	return NULL;
+}
+
+/* Join the jobserver that auth describes; FALSE if it can't be */
+int jobserver_join(char* auth)
+{
+	int comma = 0;
+	int fds[2];
+	if(('f' == auth[0]) && ('i' == auth[1]) && ('f' == auth[2]) && ('o' == auth[3]) && (':' == auth[4]))
+	{
+		jobserver_read = token_reader(auth + 5, -1);
+		if(0 > jobserver_read) return FALSE;
+		jobserver_write = token_writer(auth + 5, -1);
+		return 0 <= jobserver_write;
+	}
+
+	while((0 != auth[comma]) && (',' != auth[comma])) comma = comma + 1;
+	if(0 == auth[comma]) return FALSE;
+	auth[comma] = 0;
+	fds[0] = numerate_string(auth);
+	fds[1] = numerate_string(auth + comma + 1);
+	/* Negative is make saying there isn't one after all */
+	if((0 >= fds[0]) || (0 >= fds[1])) return FALSE;
+	jobserver_read = token_reader(NULL, fds[0]);
+	if(0 > jobserver_read) return FALSE;
+	jobserver_write = token_writer(NULL, fds[1]);
+	return 0 <= jobserver_write;
+}
+
+/* Find the jobserver kaem was given, or with serve start one for -j */
+void jobserver_start(int serve)
+{
+	int fds[2];
+	char* flags = env_lookup("MAKEFLAGS");
+	char* auth = NULL;
+	jobserver_read = -1;
+	jobserver_write = -1;
+	jobserver_tokens = calloc(JOBS + 1, sizeof(int));
+	require(jobserver_tokens != NULL, "Memory initialization of jobserver failed\n");
+	jobserver_held = 0;
+
+	if(NULL != flags)
+	{
+		auth = jobserver_option(flags, "--jobserver-auth=");
+		if(NULL == auth) auth = jobserver_option(flags, "--jobserver-fds=");
+	}
+	if(NULL != auth)
+	{
+		if(jobserver_join(auth)) return;
+		jobserver_read = -1;
+		jobserver_write = -1;
+	}
+	if((FALSE == serve) || (2 > JOBS)) return;
+
+	/* Our own, then */
+	if(FALSE == token_pool(JOBS - 1, fds)) return;
+	jobserver_read = token_reader(NULL, fds[0]);
+	jobserver_write = fds[1];
+	if(0 > jobserver_read) return;
+	auth = prepend_string("-j", prepend_string(numerate_number(JOBS), prepend_string(" --jobserver-auth=", prepend_string(numerate_number(fds[0]), prepend_string(",", numerate_number(fds[1]))))));
+	if(NULL != flags) auth = prepend_string(flags, prepend_string(" ", auth));
+	env_set("MAKEFLAGS", auth);
+}
+
+/*
+ * Whether another command may be started alongside the running ones.
+ * The first needs no token; kaem has that one already.
+ */
+int jobserver_acquire(int running)
+{
+	int token;
+	if((0 == running) || (0 > jobserver_read)) return TRUE;
+	token = token_take(jobserver_read);
+	if(0 > token) return FALSE;
+	jobserver_tokens[jobserver_held] = token;
+	jobserver_held = jobserver_held + 1;
+	return TRUE;
+}
+
+/* Commands have finished; put back any tokens that running no longer needs */
+void jobserver_release(int running)
+{
+	while((0 < jobserver_held) && (jobserver_held >= running))
+	{
+		jobserver_held = jobserver_held - 1;
+		token_give(jobserver_write, jobserver_tokens[jobserver_held]);
+	}
+}
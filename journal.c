@@ -0,0 +1,221 @@
+/* Copyright (C) 2020 fosslinux
+ * This file is part of mescc-tools.
+ *
+ * mescc-tools is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mescc-tools is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mescc-tools.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * CHECKPOINTS
+ * With --journal, kaem notes in that file each command that finishes
+ * successfully, along with each change a builtin makes to kaem itself:
+ * the env, the working directory, set -e and set -x. If a run stops part
+ * way through, --resume puts all of that back and carries on with the
+ * commands that had not finished; with -j that may be more than just the
+ * ones after the failure. A journal is only any use for the script that
+ * wrote it, so it starts with the script's SHA-256, and a journal for
+ * anything else is ignored (the script runs from the start).
+ *
+ * The file is only ever appended to and is flushed after each line, but
+ * never synced: it outlives kaem dying, which is what it is for, at the
+ * cost of a write() per command. Commands run with & are never noted as
+ * finished, so they are run again. After the kaemJOURNAL01 line, each
+ * line is a letter and then:
+ *   S hash          the script; always the first
+ *   D index         command index (counting from 0) finished
+ *   E length text   an assignment, NAME=value
+ *   U length text   unset NAME
+ *   C length text   cd text
+ *   F length text   set -text, or set -o text for pipefail
+ * where text is length bytes (newlines and all) followed by a newline.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include "kaem.h"
+
+/* Prototypes from other files */
+int chdir(char* path);
+
+/* Where lines are appended; NULL when there is no journal */
+FILE* journal;
+/* The SHA-256 of the script, taken before it is tokenized */
+char* journal_script;
+/* For each command in the program, TRUE if a journal said it finished */
+char* journal_finished_commands;
+int journal_count;
+
+/* Must be called before the script is tokenized */
+void journal_hash(struct Script* s)
+{
+	struct SHA256* c = sha256_init();
+	sha256_string(c, "kaemJOURNAL01\n");
+	sha256_update(c, s->buffer, s->length);
+	journal_script = sha256_hex(c);
+}
+
+/* The next number in s, up to a space or newline, which is skipped; -1 if none */
+int journal_number(struct Script* s)
+{
+	int r = 0;
+	int digits = 0;
+	while((s->position < s->length) && ('0' <= s->buffer[s->position]) && ('9' >= s->buffer[s->position]))
+	{
+		r = (r * 10) + (s->buffer[s->position] - '0');
+		digits = digits + 1;
+		s->position = s->position + 1;
+	}
+	if((0 == digits) || (9 < digits) || (s->position >= s->length)) return -1;
+	if((' ' != s->buffer[s->position]) && ('\n' != s->buffer[s->position])) return -1;
+	s->position = s->position + 1;
+	return r;
+}
+
+/* length bytes of text and the newline after them; NULL if they are not all there */
+char* journal_text(struct Script* s)
+{
+	int length = journal_number(s);
+	if((0 > length) || ((s->position + length) >= s->length)) return NULL;
+	if('\n' != s->buffer[s->position + length]) return NULL;
+	char* r = arena_calloc(long_arena, length + 1, sizeof(char));
+	int i;
+	for(i = 0; i < length; i = i + 1) r[i] = s->buffer[s->position + i];
+	s->position = s->position + length + 1;
+	return r;
+}
+
+/* Put back what one line of the journal says; FALSE if it makes no sense */
+int journal_apply(struct Script* s)
+{
+	int kind = s->buffer[s->position];
+	int i;
+	char* text;
+	if((s->position + 2) >= s->length) return FALSE;
+	if(' ' != s->buffer[s->position + 1]) return FALSE;
+	s->position = s->position + 2;
+	if('D' == kind)
+	{
+		i = journal_number(s);
+		if((0 > i) || (i >= journal_count)) return FALSE;
+		journal_finished_commands[i] = TRUE;
+		return TRUE;
+	}
+
+	text = journal_text(s);
+	if(NULL == text) return FALSE;
+	if('E' == kind)
+	{
+		for(i = 0; '=' != text[i]; i = i + 1)
+		{
+			if(0 == text[i]) return FALSE;
+		}
+		text[i] = 0;
+		env_set(text, text + i + 1);
+		if(match("PATH", text)) path_reset();
+	}
+	else if('U' == kind)
+	{
+		env_unset(text);
+		if(match("PATH", text)) path_reset();
+	}
+	else if('C' == kind) chdir(text);
+	else if(('F' == kind) && match("e", text)) STRICT = TRUE;
+	else if(('F' == kind) && match("x", text)) VERBOSE = TRUE;
+	else if(('F' == kind) && match("pipefail", text)) PIPEFAIL = TRUE;
+	else return FALSE;
+	return TRUE;
+}
+
+/* Pick up where the journal left off; FALSE if it is not for this script */
+int journal_resume()
+{
+	struct Script* s = arena_calloc(long_arena, 1, sizeof(struct Script));
+	char* magic = "kaemJOURNAL01\nS ";
+	int i;
+	if(FALSE == map_file(s, JOURNAL_FILE)) return FALSE;
+	if(s->length < (16 + 65)) return FALSE;
+	for(i = 0; i < 16; i = i + 1)
+	{
+		if(magic[i] != s->buffer[i]) return FALSE;
+	}
+	for(i = 0; i < 64; i = i + 1)
+	{
+		if(journal_script[i] != s->buffer[16 + i]) return FALSE;
+	}
+	if('\n' != s->buffer[16 + 64]) return FALSE;
+
+	/* A line cut short by kaem dying, and anything after it, is ignored */
+	s->position = 16 + 65;
+	int good = s->position;
+	while((s->position < s->length) && journal_apply(s))
+	{
+		good = s->position;
+	}
+
+	/* Start it again with what was good, so that what is added can be read */
+	char* temp = temp_name(JOURNAL_FILE);
+	if(write_file(temp, s->buffer, good)) replace_file(temp, JOURNAL_FILE);
+	return TRUE;
+}
+
+/*
+ * Start the journal for a program of count commands, picking up from the
+ * one there is with --resume.
+ */
+void journal_begin(int count)
+{
+	journal_count = count;
+	journal_finished_commands = arena_calloc(long_arena, count + 1, sizeof(char));
+	if(RESUME && journal_resume())
+	{
+		journal = fopen(JOURNAL_FILE, "a");
+	}
+	else
+	{
+		journal = fopen(JOURNAL_FILE, "w");
+		if(NULL == journal) return;
+		file_print("kaemJOURNAL01\nS ", journal);
+		file_print(journal_script, journal);
+		file_print("\n", journal);
+	}
+	if(NULL != journal) fflush(journal);
+}
+
+/* Whether a journal said command index finished, so it is not run again */
+int journal_finished(int index)
+{
+	if(NULL == journal_finished_commands) return FALSE;
+	return journal_finished_commands[index];
+}
+
+void journal_done(int index)
+{
+	if(NULL == journal) return;
+	file_print("D ", journal);
+	file_print(numerate_number(index), journal);
+	file_print("\n", journal);
+	fflush(journal);
+}
+
+/* Note a change a builtin made; see above for what kind is */
+void journal_note(char* kind, char* text)
+{
+	if(NULL == journal) return;
+	file_print(kind, journal);
+	file_print(" ", journal);
+	file_print(numerate_number(string_length(text)), journal);
+	file_print(" ", journal);
+	file_print(text, journal);
+	file_print("\n", journal);
+	fflush(journal);
+}
@@ -23,7 +23,11 @@
 #include "kaem.h"
 
 /* Prototypes from other files */
-void handle_variables(char** argv, struct Token* n);
+struct Segment* split_variables(char* input);
+char* expand_variables(struct Segment* head);
+char* cache_path(struct Script* s);
+struct Program* cache_load(char* path);
+void cache_store(char* path, struct Program* p);
 
 /*
  * UTILITY FUNCTIONS
@@ -52,211 +56,198 @@ int array_length(char** array)
 	return length;
 }
 
-/* Search for a variable in the env linked-list */
-char* env_lookup(char* variable)
+/* Join argv[first] onwards into one string, seperated by spaces */
+char* join_arguments(char** argv, int first)
 {
-	/* Start at the head */
-	struct Token* n = env;
-	/* Loop over the linked-list */
-	while(n != NULL)
+	int length = 0;
+	int i;
+	for(i = first; NULL != argv[i]; i = i + 1)
+	{
+		length = length + string_length(argv[i]) + 1;
+	}
+	char* result = calloc(length + 1, sizeof(char));
+	require(result != NULL, "Memory initialization of result in join_arguments failed\n");
+	char* hold = result;
+	for(i = first; NULL != argv[i]; i = i + 1)
 	{
-		if(match(variable, n->var))
-		{ /* We have found the correct node */
-			return n->value; /* Done */
+		if(i != first)
+		{
+			hold[0] = ' ';
+			hold = hold + 1;
 		}
-		/* Nope, try the next */
-		n = n->next;
+		hold = copy_string(hold, argv[i]);
 	}
-	/* We didn't find anything! */
-	return NULL;
+	return result;
 }
 
-/* Find the full path to an executable */
-char* find_executable(char* name)
-{
-	if(match("", name)) return NULL;
-	if(('.' == name[0]) || ('/' == name[0]))
-	{ /* assume names that start with . or / are relative or absolute */
-		return name;
-	}
+/*
+ * SCRIPT READING FUNCTIONS
+ */
 
-	char* trial = calloc(MAX_STRING, sizeof(char));
-	char* MPATH = calloc(MAX_STRING, sizeof(char)); /* Modified PATH */
-	require(MPATH != NULL, "Memory initialization of MPATH in find_executable failed\n");
-	copy_string(MPATH, PATH);
-	FILE* t;
-	char* next = find_char(MPATH, ':');
-	int index;
-	int offset;
-	int mpath_length;
-	int name_length;
-	int trial_length;
-	while(NULL != next)
-	{
-		/* Reset trial */
-		trial_length = string_length(trial);
-		for(index = 0; index < trial_length; index = index + 1)
+/* Append a character to the script buffer, growing it when full */
+void script_append(struct Script* s, int c)
+{
+	char* grown;
+	int i;
+	if(s->length >= s->capacity)
+	{ /* Double the buffer; there is no realloc() under M2-Planet */
+		s->capacity = (s->capacity * 2) + 4096;
+		grown = calloc(s->capacity, sizeof(char));
+		require(grown != NULL, "Memory initialization of script buffer failed\n");
+		for(i = 0; i < s->length; i = i + 1)
 		{
-			trial[index] = 0;
+			grown[i] = s->buffer[i];
 		}
+		s->buffer = grown;
+	}
+	s->buffer[s->length] = c;
+	s->length = s->length + 1;
+}
 
-		next[0] = 0;
+/*
+ * Read the next command from a script that could not be loaded whole
+ * (pipes and the like). Everything up to the end of the command is
+ * buffered so that the tokenizer never has to go back to the stream.
+ * Returns the number of characters read; 0 means the stream is done.
+ */
+int script_fill(struct Script* s)
+{
+	int c;
+	int in_string = FALSE;
+	int in_comment = FALSE;
+	s->length = 0;
+	s->position = 0;
+	while(TRUE)
+	{
+		c = fgetc(s->stream);
+		if(EOF == c) return s->length;
+		script_append(s, c);
 
-		/* prepend_string(MPATH, prepend_string("/", name)) */
-		mpath_length = string_length(MPATH);
-		for(index = 0; index < mpath_length; index = index + 1)
-		{
-			require(MAX_STRING > index, "Element of PATH is too long\n");
-			trial[index] = MPATH[index];
+		if(in_comment)
+		{ /* Comments always end at the end of the line */
+			if('\n' == c) return s->length;
 		}
-		trial[index] = '/';
-		offset = string_length(trial);
-		name_length = string_length(name);
-		for(index = 0; index < name_length; index = index + 1)
-		{
-			require(MAX_STRING > index, "Element of PATH is too long\n");
-			trial[index + offset] = name[index];
+		else if(in_string)
+		{ /* Nothing is special inside of a string except its end */
+			if('"' == c) in_string = FALSE;
 		}
-
-		/* Try the trial */
-		require(string_length(trial) < MAX_STRING, "COMMAND TOO LONG!\nABORTING HARD\n");
-		t = fopen(trial, "r");
-		if(NULL != t)
-		{
-			fclose(t);
-			return trial;
+		else if('"' == c) in_string = TRUE;
+		else if('#' == c) in_comment = TRUE;
+		else if('\\' == c)
+		{ /* The escaped character belongs to this command, even a newline */
+			c = fgetc(s->stream);
+			if(EOF == c) return s->length;
+			script_append(s, c);
 		}
-
-		MPATH = next + 1;
-		next = find_char(MPATH, ':');
+		else if('\n' == c) return s->length;
 	}
-	return NULL;
 }
 
-/* Function to convert a Token linked-list into an array of strings */
-char** list_to_array(struct Token* s)
+/*
+ * Read one more line of a streamed script onto the end of what has been
+ * buffered, for a here-document. Returns the number of characters read.
+ */
+int script_line(struct Script* s)
 {
-	struct Token* n;
-	n = s;
-	char** array = calloc(MAX_ARRAY, sizeof(char*));
-	require(array != NULL, "Memory initialization of array in conversion of list to array failed\n");
-	char* element = calloc(MAX_STRING, sizeof(char));
-	require(element != NULL, "Memory initalization of element in conversion of list to array failed\n");
-	int index = 0;
-	int i;
-	int value_length;
-	int var_length;
-	int offset;
-	while(n != NULL)
-	{ /* Loop through each node and assign it to an array index */
-		array[index] = calloc(MAX_STRING, sizeof(char));
-		require(array[index] != NULL, "Memory initialization of array[index] in conversion of list to array failed\n");
-		/* Bounds checking */
-		/* No easy way to tell which it is, output generic message */
-		require(index < MAX_ARRAY, "SCRIPT TOO LONG or TOO MANY ENVARS\nABORTING HARD\n");
-		if(n->var == NULL)
-		{ /* It is a line */
-			array[index] = n->value;
-		}
-		else
-		{ /* It is a var */
-			/* prepend_string(n->var, prepend_string("=", n->value)) */
-			var_length = string_length(n->var);
-			for(i = 0; i < var_length; i = i + 1)
-			{
-				element[i] = n->var[i];
-			}
-			element[i] = '=';
-			i = i + 1;
-			offset = i;
-			value_length = string_length(n->value);
-			for(i = 0; i < value_length; i = i + 1)
-			{
-				element[i + offset] = n->value[i];
-			}
-		}
-		copy_string(array[index], element);
-
-		n = n->next;
-		index = index + 1;
-
-		/* Reset element */
-		for(i = 0; i < MAX_STRING; i = i + 1) element[i] = 0;
+	int read = 0;
+	int c = fgetc(s->stream);
+	while(EOF != c)
+	{
+		script_append(s, c);
+		read = read + 1;
+		if('\n' == c) return read;
+		c = fgetc(s->stream);
 	}
-	return array;
+	return read;
 }
 
 /*
  * TOKEN COLLECTION FUNCTIONS
+ * Tokens are collected in place: the characters that make up a token are
+ * shifted down over the quotes and escapes that surrounded them and the
+ * result is terminated inside the script buffer itself. Nothing is copied
+ * until variable substitution has to rewrite a token.
  */
 
+/*
+ * Move the plain characters from s->position up to stop down to index,
+ * where the token is being built. Nothing moves until a quote or escape
+ * has been removed from the token, so mostly this is just a skip.
+ */
+int collect_run(struct Script* s, int index, int stop)
+{
+	if(index == s->position)
+	{
+		s->position = stop;
+		return stop;
+	}
+	while(s->position < stop)
+	{
+		s->buffer[index] = s->buffer[s->position];
+		index = index + 1;
+		s->position = s->position + 1;
+	}
+	return index;
+}
+
 /* Function for skipping over line comments */
-void collect_comment(FILE* input)
+void collect_comment(struct Script* s)
 {
-	int c;
-	/* Eat up the comment, one character at a time */
 	/*
 	 * Sanity check that the comment ends with \n.
-	 * Remove the comment from the FILE*
+	 * Skip the comment, including the \n
 	 */
-	do
-	{
-		c = fgetc(input);
-		/* We reached an EOF!! */
-		require(EOF != c, "IMPROPERLY TERMINATED LINE COMMENT!\nABORTING HARD\n");
-	} while('\n' != c); /* We can now be sure it ended with \n -- and have purged the comment */
+	s->position = scan_char(s->buffer, s->position, s->length, '\n');
+	/* We reached an EOF!! */
+	require(s->position < s->length, "IMPROPERLY TERMINATED LINE COMMENT!\nABORTING HARD\n");
+	/* We can now be sure it ended with \n -- and have purged the comment */
+	s->position = s->position + 1;
 }
 
 /* Function for collecting strings and removing the "" pair that goes with them */
-int collect_string(FILE* input, struct Token* n, int index)
+int collect_string(struct Script* s, int index)
 {
-	int string_done = FALSE;
-	int c;
-	do
-	{
-		/* Bounds check */
-		require(MAX_STRING > index, "LINE IS TOO LONG\nABORTING HARD\n");
-		c = fgetc(input);
-		require(EOF != c, "IMPROPERLY TERMINATED STRING!\nABORTING HARD\n");
-
-		if('"' == c)
-		{ /* End of string */
-			string_done = TRUE;
-		}
-		else
-		{
-			require(MAX_STRING > index, "LINE IS TOO LONG\nABORTING HARD\n");
-			n->value[index] = c;
-			index = index + 1;
-		}
-	} while(string_done == FALSE);
+	int stop = scan_char(s->buffer, s->position, s->length, '"');
+	require(stop < s->length, "IMPROPERLY TERMINATED STRING!\nABORTING HARD\n");
+	index = collect_run(s, index, stop);
+	/* Skip the closing " */
+	s->position = s->position + 1;
 	return index;
 }
 
 /* Function to parse and assign token->value */
-int collect_token(FILE* input, struct Token* n)
+int collect_token(struct Script* s, struct Token* n)
 {
 	int c;
 	int token_done = FALSE;
-	char* token = calloc(MAX_STRING, sizeof(char));
-	require(token != NULL, "Memory initialization of token in collect_token failed\n");
-	int index = 0;
+	/* The token is written over the top of the script, starting here */
+	int start = s->position;
+	int index = start;
+	/* Everything after an escape is dropped from the token */
+	int escaped = FALSE;
+	n->quoted = FALSE;
+	n->unquoted = -1;
+	int stop;
 	do
 	{ /* Loop over each character in the token */
-		c = fgetc(input);
-		/* Bounds checking */
-		require(MAX_STRING > index, "LINE IS TOO LONG\nABORTING HARD\n");
-		if(EOF == c)
+		/* Characters that are not special to the tokenizer are taken as a run */
+		stop = scan_token(s->buffer, s->position, s->length);
+		if(escaped) s->position = stop;
+		else index = collect_run(s, index, stop);
+
+		if(s->position >= s->length)
 		{ /* End of file -- this means script complete */
 			/* We don't actually exit here. This logically makes more sense;
 			 * let the code follow its natural path of execution and exit
 			 * sucessfuly at the end of main().
 			 */
-			token_done = TRUE;
 			command_done = TRUE;
 			return -1;
 		}
-		else if((' ' == c) || ('\t' == c))
+		c = s->buffer[s->position];
+		s->position = s->position + 1;
+
+		if((' ' == c) || ('\t' == c))
 		{ /* Space and tab are token seperators */
 			token_done = TRUE;
 		}
@@ -267,12 +258,15 @@ int collect_token(FILE* input, struct Token* n)
 		}
 		else if('"' == c)
 		{ /* Handle strings -- everything between a pair of "" */
-			index = collect_string(input, n, index);
+			if(FALSE == n->quoted) n->unquoted = index - start;
+			n->quoted = TRUE;
+			if(escaped) collect_string(s, s->position);
+			else index = collect_string(s, index);
 			token_done = TRUE;
 		}
 		else if('#' == c)
 		{ /* Handle line comments */
-			collect_comment(input);
+			collect_comment(s);
 			command_done = TRUE;
 			token_done = TRUE;
 		}
@@ -289,27 +283,66 @@ int collect_token(FILE* input, struct Token* n)
 			 * signficant enough, when warnings are enabled, we will give a   *
 			 * warning about this.                                            *
 			 ******************************************************************/
-			c = fgetc(input); /* Skips over \, gets the next char */
-			if(WARNINGS && c != '\n')
-			{
-				file_print("WARNING: The character '", stdout);
-				fputc(c, stdout);
-				file_print("' just got eaten up because of an unsupported escape sequence; see kaem.c:collect_token for more information.\n", stdout);
+			if(s->position < s->length)
+			{ /* Skips over \, gets the next char */
+				c = s->buffer[s->position];
+				s->position = s->position + 1;
+				if(WARNINGS && c != '\n')
+				{
+					file_print("WARNING: The character '", stdout);
+					fputc(c, stdout);
+					file_print("' just got eaten up because of an unsupported escape sequence; see kaem.c:collect_token for more information.\n", stdout);
+				}
 			}
-			index = index + 2;
+			if(FALSE == n->quoted) n->unquoted = index - start;
+			escaped = TRUE;
+			n->quoted = TRUE;
 		}
 		else if(0 == c)
 		{ /* We have come to the end of the token */
 			token_done = TRUE;
 		}
-		else
-		{ /* It's a character to assign */
-			require(MAX_STRING > index, "LINE IS TOO LONG\nABORTING HARD\n");
-			n->value[index] = c;
-			index = index + 1;
-		}
 	} while (token_done == FALSE);
-	return index;
+
+	/* Terminate the token where it lies; the delimiter is already consumed */
+	s->buffer[index] = 0;
+	if(FALSE == n->quoted) n->unquoted = index - start;
+	n->value = s->buffer + start;
+	return index - start;
+}
+
+/*
+ * Collect the body of a here-document: the lines from where the script
+ * is up to, until one that is just delimiter. Like a token it is left
+ * where it is, terminated in place of the delimiter.
+ */
+char* collect_here(struct Script* s, char* delimiter)
+{
+	int start = s->position;
+	int line;
+	int end;
+	int i;
+	int length = string_length(delimiter);
+	while(TRUE)
+	{
+		if((NULL != s->stream) && (s->position >= s->length)) script_line(s);
+		require(s->position < s->length, "HERE-DOCUMENT WITHOUT ITS END!\nABORTING HARD\n");
+		line = s->position;
+		end = scan_char(s->buffer, line, s->length, '\n');
+		s->position = end + 1;
+		if(s->position > s->length) s->position = s->length;
+		i = -1;
+		if((end - line) == length)
+		{
+			i = 0;
+			while((i < length) && (s->buffer[line + i] == delimiter[i])) i = i + 1;
+		}
+		if(i == length)
+		{
+			s->buffer[line] = 0;
+			return s->buffer + start;
+		}
+	}
 }
 
 /*
@@ -337,82 +370,62 @@ int is_envar(char* token)
 /* Add an envar */
 int add_envar()
 {
-	/* If we are in init-mode and this is the first var env == NULL, rectify */
-	if(env == NULL)
-	{
-		env = calloc(1, sizeof(struct Token));
-		require(env != NULL, "Memory initialization of env failed\n");
-	}
-
-	struct Token* n;
-	n = env;
-	/* Traverse to end of linked-list */
-	while(n->next != NULL)
-	{
-		if(n->next->value == NULL || n->next->var == NULL) break;
-		n = n->next;
-	}
-	/* Initialize new node */
-	/* See first comment, this situation means no new node */
-	if(n->value != NULL || n->var != NULL || n->next != NULL)
-	{
-		n->next = calloc(1, sizeof(struct Token));
-		require(n->next != NULL, "Memory initialization of next env node in add_envar failed\n");
-		n = n->next;
-	}
-
-	/*
-	 * If you are confused about n->* and token->value here:
-	 * token->value: is the token with the raw data. Part of token linked list.
-	 * n->*: is where it goes. Part of env linked list.
-	 */
-	/* Get n->var */
+	/* The assignment is the whole of command_argv[0], NAME=value */
+	char* assignment = command_argv[0];
 	int index = 0;
-	n->var = calloc(MAX_STRING, sizeof(char));
-	require(n->var != NULL, "Memory initialization of n->var in add_envar failed\n");
-	int token_length = string_length(token->value);
-	/* Copy into n->var up to = */
-	while(token->value[index] != '=')
-	{
-		if(index >= token_length) return TRUE;
-		n->var[index] = token->value[index];
-		index = index + 1;
-	}
-
-	/* Get n->value */
-	index = index + 1; /* Skip over = */
-	int offset = index;
-	n->value = calloc(MAX_STRING, sizeof(char));
-	require(n->value != NULL, "Memory initialization of n->value in add_envar failed\n");
-	/* Copy into n->value up to end of token */
-	while(token->value[index] != 0)
+	while(assignment[index] != '=')
 	{
-		if(index >= token_length) return TRUE;
-		n->value[index - offset] = token->value[index];
+		if(0 == assignment[index]) return TRUE;
 		index = index + 1;
 	}
+	char* name = arena_calloc(line_arena, index + 1, sizeof(char));
+	int i;
+	for(i = 0; i < index; i = i + 1) name[i] = assignment[i];
+
+	/* Everything after the = is the value */
+	env_set(name, assignment + index + 1);
+	if(match("PATH", name)) path_reset();
+	journal_note("E", assignment);
 	return FALSE;
 }
 
 /* cd builtin */
 int cd()
 {
-	if(NULL == token->next) return TRUE;
-	token = token->next;
-	if(NULL == token->value) return TRUE;
-	int ret = chdir(token->value);
+	if(2 > command_argc) return TRUE;
+	int ret = chdir(command_argv[1]);
 	if(0 > ret) return TRUE;
+	journal_note("C", command_argv[1]);
 	return FALSE;
 }
 
 /* pwd builtin */
+/* The working directory, out of arena */
+char* current_directory(struct Arena* a)
+{
+	int size = 256;
+	char* path = arena_calloc(a, size, sizeof(char));
+	getcwd(path, size);
+	while(match("", path))
+	{ /* Too small (or broken); keep doubling until the kernel would refuse anyway */
+		require(size < 1048576, "getcwd() failed\n");
+		size = size * 2;
+		path = arena_calloc(a, size, sizeof(char));
+		getcwd(path, size);
+	}
+	return path;
+}
+
+/* name, wherever cd takes kaem later */
+char* absolute_path(char* name)
+{
+	if('/' == name[0]) return name;
+	return prepend_string(current_directory(long_arena), prepend_string("/", name));
+}
+
 int pwd()
 {
-	char* path = calloc(MAX_STRING, sizeof(char));
-	require(path != NULL, "Memory initialization of path in pwd failed\n");
-	getcwd(path, MAX_STRING);
-	require(!match("", path), "getcwd() failed\n");
-	file_print(path, stdout);
+	file_print(current_directory(line_arena), stdout);
 	file_print("\n", stdout);
 	return FALSE;
 }
@@ -422,16 +435,19 @@ int set()
 {
 	/* Get the options */
 	int i;
-	if(NULL == token->next) goto cleanup_set;
-	token = token->next;
-	if(NULL == token->value) goto cleanup_set;
-	char* options = calloc(MAX_STRING, sizeof(char));
-	require(options != NULL, "Memory initialization of options in set failed\n");
+	if(2 > command_argc) goto cleanup_set;
+	if(match(command_argv[1], "-o") && (2 < command_argc) && match(command_argv[2], "pipefail"))
+	{ /* The only long option there is */
+		PIPEFAIL = TRUE;
+		journal_note("F", "pipefail");
+		return FALSE;
+	}
+	int last_position = string_length(command_argv[1]) - 1;
+	char* options = arena_calloc(line_arena, last_position + 1, sizeof(char));
 
-	int last_position = string_length(token->value) - 1;
 	for(i = 0; i < last_position; i = i + 1)
 	{
-		options[i] = token->value[i + 1];
+		options[i] = command_argv[1][i + 1];
 	}
 	/* Parse the options */
 	int options_length = string_length(options);
@@ -448,11 +464,13 @@ int set()
 		else if(options[i] == 'e')
 		{ /* Fail on failure */
 			STRICT = TRUE;
+			journal_note("F", "e");
 		}
 		else if(options[i] == 'x')
 		{ /* Show commands as executed */
 			/* TODO: this currently behaves like -v. Make it do what it should */
 			VERBOSE = TRUE;
+			journal_note("F", "x");
 			/*
 			 * Output the set -x because VERBOSE didn't catch it before.
 			 * We don't do just -x because we support multiple options in one command,
@@ -478,24 +496,12 @@ cleanup_set:
 /* echo builtin */
 void echo()
 {
-	if(token->next == NULL)
-	{ /* No arguments */
-		file_print("\n", stdout);
-		return;
-	}
-	if(token->next->value == NULL)
-	{ /* No arguments */
-		file_print("\n", stdout);
-		return;
-	}
-	token = token->next; /* Skip the actual echo */
-	while(token != NULL)
+	int i;
+	/* Skip the actual echo */
+	for(i = 1; i < command_argc; i = i + 1)
 	{ /* Output each argument to echo to stdout */
-		/* M2-Planet doesn't let us do this in the while */
-		if(token->value == NULL) break;
-		file_print(token->value, stdout);
+		file_print(command_argv[i], stdout);
 		file_print(" ", stdout);
-		token = token->next;
 	}
 	file_print("\n", stdout);
 }
@@ -503,86 +509,151 @@ void echo()
 /* unset builtin */
 void unset()
 {
-	struct Token* e;
 	/* We support multiple variables on the same line */
-	struct Token* t;
-	t = token->next;
-	while(t != NULL)
+	int i;
+	for(i = 1; i < command_argc; i = i + 1)
 	{
-		e = env;
-		/* Look for the variable; we operate on ->next because we need to remove ->next */
-		while(e->next != NULL)
+		env_unset(command_argv[i]);
+		if(match("PATH", command_argv[i])) path_reset();
+		journal_note("U", command_argv[i]);
+	}
+}
+
+/* hash builtin; hash -r forgets where everything was found */
+int hash()
+{
+	struct Executable* x;
+	int i;
+	int rc = FALSE;
+	if(1 == command_argc)
+	{ /* Show what has been found so far */
+		file_print("hits\tcommand\n", stdout);
+		for(x = executables->first; NULL != x; x = x->next)
 		{
-			if(match(e->next->var, t->value))
-			{
-				break;
-			}
-			e = e->next;
+			file_print(numerate_number(x->hits), stdout);
+			file_print("\t", stdout);
+			file_print(x->path, stdout);
+			file_print("\n", stdout);
+		}
+		file_print(numerate_number(executables->hits), stdout);
+		file_print(" hits, ", stdout);
+		file_print(numerate_number(executables->misses), stdout);
+		file_print(" misses\n", stdout);
+		return FALSE;
+	}
+
+	for(i = 1; i < command_argc; i = i + 1)
+	{
+		if(match("-r", command_argv[i])) path_reset();
+		else if(NULL == find_executable(command_argv[i]))
+		{
+			file_print("hash: ", stderr);
+			file_print(command_argv[i], stderr);
+			file_print(" not found\n", stderr);
+			rc = TRUE;
+		}
+	}
+	return rc;
+}
+
+/* wait builtin; waits for the given jobs, or all of them */
+int wait_builtin()
+{
+	struct Job* j;
+	int pid;
+	int i;
+	int rc = FALSE;
+	if(1 == command_argc) return job_finish_all();
+
+	for(i = 1; i < command_argc; i = i + 1)
+	{
+		pid = numerate_string(command_argv[i]);
+		j = job_find(pid);
+		if((0 >= pid) || (NULL == j))
+		{
+			file_print("wait: ", stderr);
+			file_print(command_argv[i], stderr);
+			file_print(" is not a job started by this kaem\n", stderr);
+			rc = TRUE;
 		}
-		t = t->next;
-		/* If it's NULL nothing was found */
-		if(e->next == NULL) continue;
-		/* Otherwise there is something to unset */
-		e->next = e->next->next;
+		else if(job_finish(j)) rc = TRUE;
 	}
+	return rc;
 }
 
 /* Execute program */
-int execute()
+int execute(int kind, int builtin, int background)
 { /* Run the command */
 
 	/* rc = return code */
 	int rc;
 
 	/* Actually do the execution */
-	if(is_envar(token->value) == TRUE)
+	if(COMMAND_ASSIGNMENT == kind)
 	{
 		rc = add_envar();
 		if(STRICT) require(rc == FALSE, "Adding of an envar failed!\n");
 		return 0;
 	}
-	else if(match(token->value, "cd"))
+	else if(BUILTIN_CD == builtin)
 	{
 		rc = cd();
 		if(STRICT) require(rc == FALSE, "cd failed!\n");
 		return 0;
 	}
-	else if(match(token->value, "set"))
+	else if(BUILTIN_SET == builtin)
 	{
 		rc = set();
 		if(STRICT) require(rc == FALSE, "set failed!\n");
 		return 0;
 	}
-	else if(match(token->value, "pwd"))
+	else if(BUILTIN_PWD == builtin)
 	{
 		rc = pwd();
 		if(STRICT) require(rc == FALSE, "pwd failed!\n");
 		return 0;
 	}
-	else if(match(token->value, "echo"))
+	else if(BUILTIN_ECHO == builtin)
 	{
 		echo();
 		return 0;
 	}
-	else if(match(token->value, "unset"))
+	else if(BUILTIN_UNSET == builtin)
 	{
 		unset();
 		return 0;
 	}
+	else if(BUILTIN_HASH == builtin)
+	{
+		rc = hash();
+		if(STRICT) require(rc == FALSE, "hash failed!\n");
+		return 0;
+	}
+	else if(BUILTIN_WAIT == builtin)
+	{
+		rc = wait_builtin();
+		if(STRICT) require(rc == FALSE, "wait failed!\n");
+		return 0;
+	}
+
+	/* Some programs kaem can do itself, unless it is told not to */
+	if((BUILTIN_NONE != builtin) && (FALSE == background) && (FALSE == FUZZING))
+	{
+		rc = run_tool(builtin, command_argv, command_argc);
+		if(0 <= rc) return rc << 8;
+	}
 
 	/* If it is not a builtin, run it as an executable */
 	int status; /* i.e. return code */
-	char** array;
-	char** envp;
 	/* Get the full path to the executable */
-	char* program = find_executable(token->value);
+	char* program = find_executable(command_argv[0]);
 	/* Check we can find the executable */
 	if(NULL == program)
 	{
 		if(STRICT == TRUE)
 		{
 			file_print("WHILE EXECUTING ", stderr);
-			file_print(token->value, stderr);
+			file_print(command_argv[0], stderr);
 			file_print(" NOT FOUND!\nABORTING HARD\n", stderr);
 			exit(EXIT_FAILURE);
 		}
@@ -590,196 +661,475 @@ int execute()
 		return 0;
 	}
 
-	int f = fork();
-	/* Ensure fork succeeded */
-	if (f == -1)
-	{
+	/* Built in the parent, and only when the env has changed */
+	char** envp = env_array();
+	/* Anything newly found is saved first, for any kaem this runs */
+	path_save();
+
+	/**************************************************************
+	 * Fuzzing produces random stuff; we don't want it running    *
+	 * dangerous commands. So we just don't run anything.         *
+	 **************************************************************/
+	if(FUZZING) return 0;
+
+	/* Anything kaem has printed comes out before what the child prints */
+	fflush(stdout);
+	/* The child does nothing but exec; see spawn() */
+	int f = spawn(program, command_argv, envp);
+	if(-1 == f)
+	{ /* Too many arguments for the kernel (ARG_MAX) ends up here */
 		file_print("WHILE EXECUTING ", stderr);
-		file_print(token->value, stderr);
-		file_print("fork() FAILED\nABORTING HARD\n", stderr);
-		exit(EXIT_FAILURE);
+		file_print(command_argv[0], stderr);
+		file_print(" execve() FAILED\n", stderr);
+		/* As if it had exited with EXIT_FAILURE */
+		return EXIT_FAILURE << 8;
 	}
-	else if (f == 0)
-	{ /* Child */
-		/**************************************************************
-		 * Fuzzing produces random stuff; we don't want it running    *
-		 * dangerous commands. So we just don't execve.               *
-		 * But, we still do the list_to_array calls to check for      *
-		 * segfaults.                                                 *
-		 **************************************************************/
-		array = list_to_array(token);
-		envp = list_to_array(env);
+	processes_spawned = processes_spawned + 1;
 
-		if(FALSE == FUZZING)
-		{ /* We are not fuzzing */
-			/* execve() returns only on error */
-			execve(program, array, envp);
-		}
-		/* Prevent infinite loops */
-		_exit(EXIT_SUCCESS);
+	if(background)
+	{ /* Leave it running; wait picks it up */
+		job_start(f);
+		return 0;
 	}
 
-	/* Otherwise we are the parent */
 	/* And we should wait for it to complete */
-	waitpid(f, &status, 0);
+	status = job_wait_for(f);
 
 	return status;
 }
 
-int collect_command(FILE* script, char** argv)
+/*
+ * COMPILATION FUNCTIONS
+ * Each line of the script is compiled into a struct Command once, up front.
+ */
+
+/* Which builtin a command name refers to, if any */
+int builtin_code(char* name)
+{
+	if(match(name, "cd")) return BUILTIN_CD;
+	if(match(name, "set")) return BUILTIN_SET;
+	if(match(name, "pwd")) return BUILTIN_PWD;
+	if(match(name, "echo")) return BUILTIN_ECHO;
+	if(match(name, "unset")) return BUILTIN_UNSET;
+	if(match(name, "hash")) return BUILTIN_HASH;
+	if(match(name, "wait")) return BUILTIN_WAIT;
+	return tool_code(name);
+}
+
+/* What kind of command a (fully substituted) command name makes */
+int command_kind(char* name)
+{
+	if(match(name, "@in") || match(name, "@out") || match(name, "@env")) return COMMAND_DECLARE;
+	if(is_envar(name)) return COMMAND_ASSIGNMENT;
+	int builtin = builtin_code(name);
+	/* The likes of mkdir are still programs; see tools.c */
+	if((BUILTIN_NONE != builtin) && (BUILTIN_MKDIR > builtin)) return COMMAND_BUILTIN;
+	return COMMAND_EXTERNAL;
+}
+
+/* Add a token to the end of a command */
+void command_add_token(struct Command* c, char* value)
+{
+	char** tokens;
+	struct Segment** segments;
+	int i;
+	if(c->count >= c->capacity)
+	{
+		c->capacity = (c->capacity * 2) + 8;
+		tokens = arena_calloc(compile_arena, c->capacity, sizeof(char*));
+		segments = arena_calloc(compile_arena, c->capacity, sizeof(struct Segment*));
+		for(i = 0; i < c->count; i = i + 1)
+		{
+			tokens[i] = c->tokens[i];
+			segments[i] = c->segments[i];
+		}
+		c->tokens = tokens;
+		c->segments = segments;
+	}
+	c->tokens[c->count] = value;
+	/* Split out any variables now so that running it is cheap */
+	c->segments[c->count] = split_variables(value);
+	c->count = c->count + 1;
+}
+
+/* Decide what kind of command c is, unless we have to wait for a variable */
+void command_classify(struct Command* c)
+{
+	if(NULL != c->segments[0])
+	{
+		c->kind = COMMAND_UNKNOWN;
+	}
+	else
+	{
+		c->kind = command_kind(c->tokens[0]);
+		c->builtin = builtin_code(c->tokens[0]);
+	}
+}
+
+/* Compile the next line of the script; NULL when the script is done */
+struct Command* collect_command(struct Script* s)
 {
 	command_done = FALSE;
-	/* Initialize token */
-	token = calloc(1, sizeof(struct Token));
-	require(token != NULL, "Memory initialization of token in collect_command failed\n");
-	struct Token* n;
-	n = token;
+	/* Streamed scripts are read in one command at a time */
+	if((NULL != s->stream) && (s->position >= s->length))
+	{
+		script_fill(s);
+	}
+	struct Command* c = arena_calloc(compile_arena, 1, sizeof(struct Command));
+	struct Token* n = arena_calloc(compile_arena, 1, sizeof(struct Token));
 	int index = 0;
+	/* Where the last & was, if there was one */
+	int ampersand = -1;
+	int i;
+	struct Redirect* r;
+	struct Redirect* last = NULL;
+	/* A redirection still waiting for the word naming its file */
+	struct Redirect* pending = NULL;
+	/* The command of the pipeline the tokens are going to; just c without a | */
+	struct Command* stage = c;
+	struct Command* each;
+	/* The last token went to a redirection */
+	int redirected = FALSE;
 	/* Get the tokens */
 	while(command_done == FALSE)
 	{
-		n->value = calloc(MAX_STRING, sizeof(char));
-		index = collect_token(script, n);
-		/* Don't allocate another node if the current one yielded nothing, OR
-		 * if we are done.
+		index = collect_token(s, n);
+		/* -1 means the script is done */
+		if(EOF == index) return NULL;
+		if((FALSE == n->quoted) && match(n->value, "&")) ampersand = stage->count;
+		r = redirect_parse(n);
+		if((NULL != pending) && (FALSE == match(n->value, "")))
+		{ /* Whatever it is, it is the file, unless it is another operator */
+			require((NULL == r) && (n->quoted || ((FALSE == match(n->value, "|")) && (FALSE == match(n->value, "&")))), "REDIRECTION WITHOUT A FILE!\nABORTING HARD\n");
+			redirect_target(pending, n->value, n->quoted);
+			pending = NULL;
+			redirected = TRUE;
+		}
+		else if(NULL != r)
+		{ /* Kept apart from the arguments; see redirect.c */
+			if(NULL == last) stage->redirects = r;
+			else last->next = r;
+			last = r;
+			if(NULL == r->target) pending = r;
+			redirected = TRUE;
+		}
+		else if((FALSE == n->quoted) && match(n->value, "|"))
+		{ /* The rest is the next command of the pipeline; see pipeline.c */
+			require(0 != stage->count, "PIPE WITHOUT A COMMAND!\nABORTING HARD\n");
+			command_classify(stage);
+			stage->pipe = arena_calloc(compile_arena, 1, sizeof(struct Command));
+			stage = stage->pipe;
+			last = NULL;
+			/* An & before the | is just another argument */
+			ampersand = -1;
+		}
+		/*
+		 * Empty tokens are dropped, unless they finish the command;
+		 * the last token of a line is always kept, unless what came
+		 * before it went to a redirection.
 		 */
-		if((n->value != NULL && match(n->value, "") == FALSE) && command_done == FALSE)
+		else if((command_done && (FALSE == redirected)) || (FALSE == match(n->value, "")))
 		{
-			n->next = calloc(MAX_STRING, sizeof(char));
-			require(token != NULL, "Memory initialization of next token node in collect_command failed\n");
-			n = n->next;
+			command_add_token(stage, n->value);
+			redirected = FALSE;
 		}
 	}
-	/* -1 means the script is done */
-	if(EOF == index) return index;
+	require(NULL == pending, "REDIRECTION WITHOUT A FILE!\nABORTING HARD\n");
 
-	n = token;
-	while(n != NULL)
-	{ /* Substitute variables into each token */
-		if(n->value == NULL) break;
-		handle_variables(argv, n);
-		/* Advance to next node */
-		n = n->next;
+	/* Here-documents follow the line, one after another */
+	for(each = c; NULL != each; each = each->pipe)
+	{
+		for(r = each->redirects; NULL != r; r = r->next)
+		{
+			if(REDIRECT_HERE == r->mode) redirect_body(r, collect_here(s, r->target));
+		}
 	}
 
-	/* Output the command if verbose is set */
-	/* Also if there is nothing in the command skip over */
-	if(VERBOSE && match(token->value, "") == FALSE)
+	/* An & at the end puts the command (or the whole pipeline) in the background */
+	if(0 <= ampersand)
 	{
-		n = token;
-		file_print(" +> ", stdout);
-		while(n != NULL)
-		{ /* Print out each token token */
-			/* M2-Planet doesn't let us do this in the while */
-			if(n->value == NULL) break;
-			file_print(n->value, stdout);
-			file_print(" ", stdout);
-			n = n->next;
+		c->background = TRUE;
+		for(i = ampersand + 1; i < stage->count; i = i + 1)
+		{ /* Anything after it makes it just another argument */
+			if(FALSE == match(stage->tokens[i], "")) c->background = FALSE;
 		}
-		fputc('\n', stdout);
-		fflush(stdout);
+		if(c->background) stage->count = ampersand;
 	}
-	return index;
+
+	/* A line with nothing on it runs nothing */
+	if((1 == stage->count) && match(stage->tokens[0], "")) stage->count = 0;
+	if(c != stage) require(0 != stage->count, "PIPE WITHOUT A COMMAND!\nABORTING HARD\n");
+	if(0 == c->count)
+	{
+		require(NULL == c->redirects, "REDIRECTION WITHOUT A COMMAND!\nABORTING HARD\n");
+		return c;
+	}
+	command_classify(stage);
+	return c;
 }
 
-/* Function for executing our programs with desired arguments */
-void run_script(FILE* script, char** argv)
+/*
+ * EXECUTOR FUNCTIONS
+ */
+
+/* Substitute variables and set up command_argv, ready to execute */
+void prepare_command(struct Command* c)
 {
-	while(TRUE)
+	int i;
+	/* One extra for the NULL that execve() needs on the end */
+	command_argv = arena_calloc(line_arena, c->count + 1, sizeof(char*));
+	command_argc = c->count;
+	for(i = 0; i < c->count; i = i + 1)
 	{
-		/*
-		 * Tokens has to be reset each time, as we need a new linked-list for
-		 * each line.
-		 * See, the program flows like this as a high level overview:
-		 * Get line -> Sanitize line and perform variable replacement etc ->
-		 * Execute line -> Next.
-		 * We don't need the previous lines once they are done with, so tokens
-		 * are hence for each line.
-		 */
-		int index = collect_command(script, argv);
-		/* -1 means the script is done */
-		if(EOF == index) break;
-
-		/* Stuff to exec */
-		int status = execute();
-		if(STRICT == TRUE && (0 != status))
-		{ /* Clearly the script hit an issue that should never have happened */
-			file_print("Subprocess error ", stderr);
-			file_print(numerate_number(status), stderr);
-			file_print("\nABORTING HARD\n", stderr);
-			exit(EXIT_FAILURE);
+		if(NULL == c->segments[i]) command_argv[i] = c->tokens[i];
+		else command_argv[i] = expand_variables(c->segments[i]);
+	}
+}
+
+/* Output a command as it is run, for verbose */
+void show_command(char** argv, int argc, int background)
+{
+	int i;
+	file_print(" +> ", stdout);
+	for(i = 0; i < argc; i = i + 1)
+	{ /* Print out each token */
+		file_print(argv[i], stdout);
+		file_print(" ", stdout);
+	}
+	if(background) file_print("&", stdout);
+	fputc('\n', stdout);
+	fflush(stdout);
+}
+
+/* Say whether a command runs and why, for --explain */
+void explain_command(char* name, int runs, char* reason)
+{
+	file_print("explain: ", stdout);
+	file_print(name, stdout);
+	if(runs) file_print(" runs, ", stdout);
+	else file_print(" is skipped, ", stdout);
+	file_print(reason, stdout);
+	fputc('\n', stdout);
+}
+
+/* Deal with how a command went, once it has been run */
+void command_finish(struct Command* c, int status)
+{
+	commands_run = commands_run + 1;
+	if(STRICT == TRUE && (0 != status))
+	{ /* Clearly the script hit an issue that should never have happened */
+		file_print("Subprocess error ", stderr);
+		file_print(numerate_number(status), stderr);
+		file_print("\nABORTING HARD\n", stderr);
+		exit(EXIT_FAILURE);
+	}
+	if((0 == status) && (FALSE == c->background)) journal_done(command_index);
+
+	/* Nothing from this line is needed any more */
+	arena_reset(line_arena);
+}
+
+/* Run a single compiled command */
+void run_command(struct Command* c)
+{
+	int kind = c->kind;
+	int builtin = c->builtin;
+	if(0 == c->count) return;
+	/* Only -j has any use for what a command reads and writes */
+	if(COMMAND_DECLARE == kind) return;
+	if(NULL != c->pipe)
+	{ /* See pipeline.c */
+		command_finish(c, pipeline_run(c));
+		return;
+	}
+	prepare_command(c);
+	if(COMMAND_UNKNOWN == kind)
+	{ /* Now the variables are filled in we know what it is */
+		kind = command_kind(command_argv[0]);
+		builtin = builtin_code(command_argv[0]);
+		if(COMMAND_DECLARE == kind)
+		{
+			arena_reset(line_arena);
+			return;
 		}
 	}
+	if(EXPLAIN && (COMMAND_EXTERNAL == kind))
+	{ /* Only what is declared is ever skipped */
+		if(c->background) explain_command(command_argv[0], TRUE, "it runs in the background");
+		else explain_command(command_argv[0], TRUE, "it declares nothing");
+	}
+	if(VERBOSE) show_command(command_argv, command_argc, c->background);
+
+	/* Stuff to exec */
+	if(c->background && (COMMAND_EXTERNAL != kind) && WARNINGS)
+	{
+		file_print("WARNING: ", stdout);
+		file_print(command_argv[0], stdout);
+		file_print(" is not a program, so it is run in the foreground despite the &\n", stdout);
+	}
+	int status;
+	int* saved = NULL;
+	if((NULL != c->redirects) && (FALSE == FUZZING)) saved = redirect_apply(c->redirects);
+	/* One that couldn't be done is as if the command had failed */
+	if((NULL != c->redirects) && (FALSE == FUZZING) && (NULL == saved)) status = EXIT_FAILURE << 8;
+	else status = execute(kind, builtin, c->background);
+	redirect_restore(saved, redirect_count(c->redirects));
+	command_finish(c, status);
+}
+
+/* Add a command to the end of a program */
+void program_add_command(struct Program* p, struct Command* c)
+{
+	struct Command** grown;
+	int i;
+	if(p->count >= p->capacity)
+	{
+		p->capacity = (p->capacity * 2) + 64;
+		grown = arena_calloc(compile_arena, p->capacity, sizeof(struct Command*));
+		for(i = 0; i < p->count; i = i + 1) grown[i] = p->commands[i];
+		p->commands = grown;
+	}
+	p->commands[p->count] = c;
+	p->count = p->count + 1;
 }
 
-/* Function to populate env */
-void populate_env(char** envp)
+/* Compile every line of a script that has been loaded whole */
+struct Program* compile_script(struct Script* script)
 {
-	/* Initialize env and n */
-	env = calloc(1, sizeof(struct Token));
-	require(env != NULL, "Memory initialization of env failed\n");
-	struct Token* n;
-	n = env;
+	struct Program* p = arena_calloc(compile_arena, 1, sizeof(struct Program));
+	struct Command* c = collect_command(script);
+	while(NULL != c)
+	{
+		if(0 != c->count) program_add_command(p, c);
+		c = collect_command(script);
+	}
+	return p;
+}
 
+/* Function for executing our programs with desired arguments */
+void run_script(struct Script* script)
+{
+	struct Command* c;
+	struct Program* p = NULL;
+	char* cache = NULL;
 	int i;
-	for(i = 0; i < array_length(envp); i = i + 1)
+
+	if(NULL != script->stream)
+	{ /* We can only see as far as the current line; run them as they come, -j or not */
+		compile_arena = line_arena;
+		c = collect_command(script);
+		while(NULL != c)
+		{
+			if(FALSE == CHECK_ONLY) run_command(c);
+			c = collect_command(script);
+		}
+		return;
+	}
+
+	/*
+	 * The program flows like this as a high level overview:
+	 * Compile every line (tokenize, split out variables, classify) ->
+	 * Execute each compiled command in turn, substituting variables as
+	 * it goes. Anything wrong with the script is caught before anything
+	 * has been run.
+	 * Compiling is skipped altogether when the cache already has it.
+	 */
+	compile_arena = long_arena;
+	if(NULL != JOURNAL_FILE) journal_hash(script);
+	if(NULL != CACHE_DIR)
 	{
-		n->var = calloc(MAX_STRING, sizeof(char));
-		require(n->var != NULL, "Memory initialization of n->var in population of env failed\n");
-		n->value = calloc(MAX_STRING, sizeof(char));
-		require(n->value != NULL, "Memory initialization of n->var in population of env failed\n");
-		int j = 0;
-		/*
-		 * envp is weird.
-		 * When referencing envp[i]'s characters directly, they were all jumbled.
-		 * So just copy envp[i] to envp_line, and work with that - that seems
-		 * to fix it.
-		 */
-		char* envp_line = calloc(MAX_STRING, sizeof(char));
-		require(envp_line != NULL, "Memory initialization of envp_line in population of env failed\n");
-		copy_string(envp_line, envp[i]);
-		while(envp_line[j] != '=')
-		{ /* Copy over everything up to = to var */
-			n->var[j] = envp_line[j];
-			j = j + 1;
-		}
-		/* If we get strange input, we need to ignore it */
-		if(n->var == NULL) continue;
-		j = j + 1; /* Skip over = */
-		int k = 0; /* As envp[i] will continue as j but n->value begins at 0 */
-		while(envp_line[j] != 0)
-		{ /* Copy everything else to value */
-			n->value[k] = envp_line[j];
-			j = j + 1;
-			k = k + 1;
-		}
-		/* Sometimes, we get lines like VAR=, indicating nothing is in the variable */
-		if(n->value == NULL) n->value = "";
-		/* Advance to next part of linked list */
-		n->next = calloc(1, sizeof(struct Token));
-		require(n->next != NULL, "Memory initialization of n->next in population of env failed\n");
-		n = n->next;
-	}
-	/* Get rid of node on the end */
-	n = NULL;
-	/* Also destroy the n->next reference */
-	n = env;
-	while(n->next->var != NULL) n = n->next;
-	n->next = NULL;
+		cache = cache_path(script);
+		p = cache_load(cache);
+	}
+	if(NULL == p)
+	{
+		p = compile_script(script);
+		if(NULL != cache) cache_store(cache, p);
+	}
+	if(CHECK_ONLY) return;
+	if(NULL != JOURNAL_FILE) journal_begin(p->count);
+
+	if((1 < JOBS) || (NULL != STATE_FILE) || EXPLAIN || (NULL != STORE_DIR))
+	{ /* See schedule.c */
+		run_parallel(p);
+		return;
+	}
+	for(i = 0; i < p->count; i = i + 1)
+	{
+		if(journal_finished(i)) continue;
+		command_index = i;
+		run_command(p->commands[i]);
+	}
+}
+
+/* Report what --stats asked for */
+void report_stats()
+{
+	file_print("kaem stats:\ncommands run: ", stderr);
+	file_print(numerate_number(commands_run), stderr);
+	file_print("\nprocesses spawned: ", stderr);
+	file_print(numerate_number(processes_spawned), stderr);
+	file_print("\n", stderr);
+	if(NULL != STATE_FILE)
+	{
+		file_print("commands up to date: ", stderr);
+		file_print(numerate_number(commands_skipped), stderr);
+		file_print("\n", stderr);
+	}
+	if(NULL != STORE_DIR)
+	{
+		file_print("commands from the store: ", stderr);
+		file_print(numerate_number(commands_restored), stderr);
+		file_print(", put in it: ", stderr);
+		file_print(numerate_number(commands_stored), stderr);
+		file_print("\n", stderr);
+	}
+	arena_report("line memory", line_arena);
+	arena_report("long-lived memory", long_arena);
+	file_print("executable lookups: ", stderr);
+	file_print(numerate_number(executables->hits), stderr);
+	file_print(" hits, ", stderr);
+	file_print(numerate_number(executables->misses), stderr);
+	file_print(" misses\n", stderr);
+	int peak = peak_memory();
+	if(0 <= peak)
+	{
+		file_print("peak resident memory: ", stderr);
+		file_print(numerate_number(peak), stderr);
+		file_print(" KiB\n", stderr);
+	}
 }
 
 int main(int argc, char** argv, char** envp)
 {
 	VERBOSE = FALSE;
 	STRICT = FALSE;
+	ARGUMENTS = "";
+	VERSION = "0.8.0";
+	CACHE_DIR = NULL;
+	HASH_CACHE = NULL;
+	CHECK_ONLY = FALSE;
+	STATS = FALSE;
+	JOBS = 1;
+	STATE_FILE = NULL;
+	EXPLAIN = FALSE;
+	STORE_DIR = NULL;
+	JOURNAL_FILE = NULL;
+	RESUME = FALSE;
+	JOBSERVER = FALSE;
+	TOOLS = TRUE;
+	PIPEFAIL = FALSE;
 	FUZZING = FALSE;
 	WARNINGS = FALSE;
 	char* filename = "kaem.run";
 	FILE* script = NULL;
 
 	/* Initalize structs */
-	token = calloc(1, sizeof(struct Token));
-	require(token != NULL, "Memory initialization of token failed\n");
+	line_arena = arena_new(64 * 1024);
+	long_arena = arena_new(256 * 1024);
+	env = env_new(64);
+	compile_arena = long_arena;
+	commands_run = 0;
 
 	int i = 1;
 	/* Loop over arguments */
@@ -793,7 +1143,7 @@ int main(int argc, char** argv, char** envp)
 		{ /* Help information */
 			file_print("Usage: ", stdout);
 			file_print(argv[0], stdout);
-			file_print(" [-h | --help] [-V | --version] [--file filename | -f filename] [-i | --init-mode] [-v | --verbose] [--strict] [--warn] [--fuzz]\n", stdout);
+			file_print(" [-h | --help] [-V | --version] [--file filename | -f filename] [-i | --init-mode] [-v | --verbose] [--strict] [--warn] [--fuzz] [--check] [--cache-dir directory] [--hash-cache file] [-j [jobs] | --jobs [jobs]] [--jobserver] [--state file] [--explain] [--store directory] [--journal file [--resume]] [--no-builtins] [--pipefail] [--stats]\n", stdout);
 			exit(EXIT_SUCCESS);
 		}
 		else if(match(argv[i], "-f") || match(argv[i], "--file"))
@@ -811,7 +1161,9 @@ int main(int argc, char** argv, char** envp)
 		}
 		else if(match(argv[i], "-V") || match(argv[i], "--version"))
 		{ /* Output version */
-			file_print("kaem version 0.8.0\n", stdout);
+			file_print("kaem version ", stdout);
+			file_print(VERSION, stdout);
+			file_print("\n", stdout);
 			exit(EXIT_SUCCESS);
 		}
 		else if(match(argv[i], "-v") || match(argv[i], "--verbose"))
@@ -824,6 +1176,11 @@ int main(int argc, char** argv, char** envp)
 			STRICT = TRUE;
 			i = i + 1;
 		}
+		else if(match(argv[i], "--pipefail"))
+		{ /* A pipeline fails if any of it fails */
+			PIPEFAIL = TRUE;
+			i = i + 1;
+		}
 		else if(match(argv[i], "--warn"))
 		{ /* Set warnings */
 			WARNINGS = TRUE;
@@ -834,8 +1191,90 @@ int main(int argc, char** argv, char** envp)
 			FUZZING = TRUE;
 			i = i + 1;
 		}
+		else if(match(argv[i], "--stats"))
+		{ /* Report on memory use at exit */
+			STATS = TRUE;
+			i = i + 1;
+		}
+		else if(match(argv[i], "--check"))
+		{ /* Compile the script but don't run it */
+			CHECK_ONLY = TRUE;
+			i = i + 1;
+		}
+		else if(match(argv[i], "--cache-dir"))
+		{ /* Keep compiled scripts in this directory */
+			if(argv[i + 1] != NULL)
+			{
+				CACHE_DIR = argv[i + 1];
+			}
+			i = i + 2;
+		}
+		else if(match(argv[i], "--hash-cache"))
+		{ /* Remember where executables were found in this file */
+			if(argv[i + 1] != NULL)
+			{
+				HASH_CACHE = argv[i + 1];
+			}
+			i = i + 2;
+		}
+		else if(match(argv[i], "-j") || match(argv[i], "--jobs"))
+		{ /* Run declared commands side by side; one per CPU if not told how many */
+			i = i + 1;
+			JOBS = 0;
+			if((NULL != argv[i]) && (0 < numerate_string(argv[i])))
+			{
+				JOBS = numerate_string(argv[i]);
+				i = i + 1;
+			}
+			JOBS = parallel_jobs(JOBS);
+		}
+		else if(match(argv[i], "--no-builtins"))
+		{
+			TOOLS = FALSE;
+			i = i + 1;
+		}
+		else if(match(argv[i], "--jobserver"))
+		{ /* Share -j with any makes we run */
+			JOBSERVER = TRUE;
+			i = i + 1;
+		}
+		else if(match(argv[i], "--state"))
+		{ /* Skip declared commands that are up to date */
+			if(argv[i + 1] != NULL)
+			{
+				STATE_FILE = argv[i + 1];
+			}
+			i = i + 2;
+		}
+		else if(match(argv[i], "--store"))
+		{ /* Reuse what declared commands produced before, here or elsewhere */
+			if(argv[i + 1] != NULL)
+			{
+				STORE_DIR = argv[i + 1];
+			}
+			i = i + 2;
+		}
+		else if(match(argv[i], "--journal"))
+		{ /* Note each command as it finishes */
+			if(argv[i + 1] != NULL)
+			{
+				JOURNAL_FILE = argv[i + 1];
+			}
+			i = i + 2;
+		}
+		else if(match(argv[i], "--resume"))
+		{ /* Carry on from where the journal says the last run got to */
+			RESUME = TRUE;
+			i = i + 1;
+		}
+		else if(match(argv[i], "--explain"))
+		{ /* Say why each command runs or not */
+			EXPLAIN = TRUE;
+			i = i + 1;
+		}
 		else if(match(argv[i], "--"))
-		{ /* Nothing more after this */
+		{ /* Nothing more after this; the rest is for $@ */
+			ARGUMENTS = join_arguments(argv, i + 1);
 			break;
 		}
 		else
@@ -851,26 +1290,24 @@ int main(int argc, char** argv, char** envp)
 		populate_env(envp);
 	}
 
-	/* Populate PATH variable
-	 * We don't need to calloc() because env_lookup() does this for us.
-	 */
-	PATH = env_lookup("PATH");
-
-	/* Populate USERNAME variable */
-	char* USERNAME = env_lookup("LOGNAME");
-
-	/* Handle edge cases */
-	if((NULL == PATH) && (NULL == USERNAME))
-	{ /* We didn't find either of PATH or USERNAME -- use a generic PATH */
-		PATH = calloc(MAX_STRING, sizeof(char));
-		require(PATH != NULL, "Memory initialization of PATH failed\n");
-		copy_string(PATH, "/root/bin:/usr/local/sbin:/usr/local/bin:/usr/sbin:/usr/bin:/sbin:/bin");
+	/* Where found executables are remembered between runs, if anywhere */
+	if(NULL != HASH_CACHE)
+	{ /* Pass it on to any kaem we run, which may be somewhere else */
+		HASH_CACHE = absolute_path(HASH_CACHE);
+		env_set("KAEM_HASH_CACHE", HASH_CACHE);
 	}
-	else if(NULL == PATH)
-	{ /* We did find a username but not a PATH -- use a generic PATH but with /home/USERNAME */
-		PATH = prepend_string("/home/", prepend_string(USERNAME,"/bin:/usr/local/bin:/usr/bin:/bin:/usr/local/games:/usr/games"));
+	else
+	{
+		HASH_CACHE = env_lookup("KAEM_HASH_CACHE");
+		if(NULL != HASH_CACHE) HASH_CACHE = arena_string(long_arena, HASH_CACHE);
 	}
 
+	/* Populate PATH variable */
+	path_reset();
+
+	/* Take part in any make -j going on, or start one for -j */
+	if(1 < JOBS) jobserver_start(JOBSERVER);
+
 	/* Open the script */
 	script = fopen(filename, "r");
 	if(NULL == script)
@@ -881,10 +1318,31 @@ int main(int argc, char** argv, char** envp)
 		exit(EXIT_FAILURE);
 	}
 
+	/* Load it whole if we can, otherwise read it as we go */
+	struct Script* s = calloc(1, sizeof(struct Script));
+	require(s != NULL, "Memory initialization of script failed\n");
+	if(FALSE == load_script(s, script))
+	{
+		s->stream = script;
+	}
+
+	/* The script may well cd somewhere else */
+	if(NULL != STATE_FILE) STATE_FILE = absolute_path(STATE_FILE);
+	if(NULL != STORE_DIR) STORE_DIR = absolute_path(STORE_DIR);
+	if(NULL != JOURNAL_FILE) JOURNAL_FILE = absolute_path(JOURNAL_FILE);
+
+	/* What was run last time */
+	if(NULL != STATE_FILE) state_load();
+
 	/* Run the commands */
-	run_script(script, argv);
+	run_script(s);
+	path_save();
+	state_save();
+	/* Anything still running in the background is waited for */
+	if(job_finish_all() && STRICT) exit(EXIT_FAILURE);
 
 	/* Cleanup */
 	fclose(script);
+	if(STATS) report_stats();
 	return EXIT_SUCCESS;
 }
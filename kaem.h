@@ -24,19 +24,106 @@
 //CONSTANT FALSE 0
 #define TRUE 1
 //CONSTANT TRUE 1
-#define MAX_STRING 4096
-//CONSTANT MAX_STRING 4096
-#define MAX_ARRAY 256
-//CONSTANT MAX_ARRAY 256
+
+/* Segment types; see variable.c */
+#define SEGMENT_TEXT 0
+//CONSTANT SEGMENT_TEXT 0
+#define SEGMENT_VARIABLE 1
+//CONSTANT SEGMENT_VARIABLE 1
+#define SEGMENT_IFSET 2
+//CONSTANT SEGMENT_IFSET 2
+#define SEGMENT_ALL 3
+//CONSTANT SEGMENT_ALL 3
+
+/* Kinds of command, decided when the script is compiled */
+#define COMMAND_EXTERNAL 0
+//CONSTANT COMMAND_EXTERNAL 0
+#define COMMAND_ASSIGNMENT 1
+//CONSTANT COMMAND_ASSIGNMENT 1
+#define COMMAND_BUILTIN 2
+//CONSTANT COMMAND_BUILTIN 2
+/* The command name has a variable in it, so wait and see */
+#define COMMAND_UNKNOWN 3
+//CONSTANT COMMAND_UNKNOWN 3
+/* @in, @out or @env, saying what the next command reads, writes or depends on */
+#define COMMAND_DECLARE 4
+//CONSTANT COMMAND_DECLARE 4
+
+/* Builtins */
+#define BUILTIN_NONE 0
+//CONSTANT BUILTIN_NONE 0
+#define BUILTIN_CD 1
+//CONSTANT BUILTIN_CD 1
+#define BUILTIN_SET 2
+//CONSTANT BUILTIN_SET 2
+#define BUILTIN_PWD 3
+//CONSTANT BUILTIN_PWD 3
+#define BUILTIN_ECHO 4
+//CONSTANT BUILTIN_ECHO 4
+#define BUILTIN_UNSET 5
+//CONSTANT BUILTIN_UNSET 5
+#define BUILTIN_HASH 6
+//CONSTANT BUILTIN_HASH 6
+#define BUILTIN_WAIT 7
+//CONSTANT BUILTIN_WAIT 7
+/* Programs kaem can do itself; the commands are still COMMAND_EXTERNAL */
+#define BUILTIN_MKDIR 8
+//CONSTANT BUILTIN_MKDIR 8
+#define BUILTIN_RM 9
+//CONSTANT BUILTIN_RM 9
+#define BUILTIN_CHMOD 10
+//CONSTANT BUILTIN_CHMOD 10
+#define BUILTIN_TOUCH 11
+//CONSTANT BUILTIN_TOUCH 11
+#define BUILTIN_MV 12
+//CONSTANT BUILTIN_MV 12
+#define BUILTIN_LN 13
+//CONSTANT BUILTIN_LN 13
+#define BUILTIN_CP 14
+//CONSTANT BUILTIN_CP 14
+#define BUILTIN_CAT 15
+//CONSTANT BUILTIN_CAT 15
+#define BUILTIN_SHA256SUM 16
+//CONSTANT BUILTIN_SHA256SUM 16
+
+/* What a redirection does with its fd; see redirect.c */
+#define REDIRECT_WRITE 0
+//CONSTANT REDIRECT_WRITE 0
+#define REDIRECT_APPEND 1
+//CONSTANT REDIRECT_APPEND 1
+#define REDIRECT_READ 2
+//CONSTANT REDIRECT_READ 2
+#define REDIRECT_DUP 3
+//CONSTANT REDIRECT_DUP 3
+#define REDIRECT_HERE 4
+//CONSTANT REDIRECT_HERE 4
+
+/* The errno values tools.c needs to tell apart (Linux's) */
+#define ERROR_NOENT 2
+//CONSTANT ERROR_NOENT 2
+#define ERROR_BADF 9
+//CONSTANT ERROR_BADF 9
+#define ERROR_ACCES 13
+//CONSTANT ERROR_ACCES 13
+#define ERROR_XDEV 18
+//CONSTANT ERROR_XDEV 18
+#define ERROR_NOTDIR 20
+//CONSTANT ERROR_NOTDIR 20
+#define ERROR_ISDIR 21
+//CONSTANT ERROR_ISDIR 21
+#define ERROR_PIPE 32
+//CONSTANT ERROR_PIPE 32
 
 /* Imported */
 int match(char* a, char* b);
+int in_set(int c, char* s);
 void file_print(char* s, FILE* f);
 void require(int bool, char* error);
 char* copy_string(char* target, char* source);
 char* prepend_string(char* add, char* base);
 int string_length(char* a);
 char* numerate_number(int a);
+int numerate_string(char* a);
 
 /*
  * GLOBALS
@@ -49,31 +136,508 @@ int INIT_MODE;
 int FUZZING;
 int WARNINGS;
 char* PATH;
+/* What $@ expands to; the arguments given to kaem after -- */
+char* ARGUMENTS;
+char* VERSION;
+/* Where compiled scripts are cached; NULL for no cache */
+char* CACHE_DIR;
+/* Where found executables are remembered between runs; NULL for nowhere */
+char* HASH_CACHE;
+/* Only compile the script, don't run it */
+int CHECK_ONLY;
+/* Report on memory and such at exit */
+int STATS;
+/* How many commands may run at once; see schedule.c */
+int JOBS;
+/* Where to remember how declared commands were run; NULL for nowhere */
+char* STATE_FILE;
+/* Say why each command runs, or is skipped */
+int EXPLAIN;
+/* Where results of declared commands are kept for reuse; NULL for nowhere */
+char* STORE_DIR;
+/* Where finished commands are noted, for RESUME; NULL for nowhere */
+char* JOURNAL_FILE;
+/* Carry on from where JOURNAL_FILE says the last run got to */
+int RESUME;
+/* Start a jobserver for -j when there isn't one already */
+int JOBSERVER;
+/* Do mkdir, rm and the like without running them; see tools.c */
+int TOOLS;
+/* A pipeline fails when any of it does, not just when its last command does */
+int PIPEFAIL;
+
+/* Here is the token struct. collect_token() hands back the token it collected in it. */
+struct Token 
+{
+	char* value;
+	/* Some of it was in "" or escaped, so it is not an operator like & */
+	int quoted;
+	/* How much of it came before anything in "" or escaped */
+	int unquoted;
+};
 
 /*
- * Here is the token struct. It is used for both the token linked-list and
- * env linked-list.
+ * The script being run. Normally the whole file is loaded (or mapped) into
+ * buffer up front and stream is NULL. When that is not possible (pipes and
+ * the like) stream is read one command at a time into buffer instead.
+ * Tokens are collected in place, so buffer must be writable.
  */
-struct Token 
+struct Script
 {
+	char* buffer;
+	int length;
+	int capacity;
+	/* Where the tokenizer is up to in buffer */
+	int position;
+	FILE* stream;
+};
+
+/* Platform specific; see platform.c, scan.c and platform_m2.c */
+int load_script(struct Script* s, FILE* f);
+int scan_token(char* buffer, int position, int length);
+int scan_char(char* buffer, int position, int length, int c);
+char* temp_name(char* name);
+int write_file(char* name, char* data, int length);
+int replace_file(char* from, char* to);
+int peak_memory();
+int is_executable(char* path);
+int spawn(char* program, char** argv, char** envp);
+int map_file(struct Script* s, char* name);
+void unmap_file(struct Script* s);
+char* file_stamp(char* name);
+int parallel_jobs(int requested);
+int spawn_captured(char* program, char** argv, char** envp, char* out, char* err);
+int replay_file(char* name, FILE* to);
+int make_directory(char* name);
+int copy_file(char* from, char* to);
+int token_reader(char* path, int fd);
+int token_writer(char* path, int fd);
+int token_take(int fd);
+void token_give(int fd, int token);
+int token_pool(int tokens, int* fds);
+void script_append(struct Script* s, int c);
+int fs_supported();
+char* fs_error(int e);
+int fs_umask();
+int fs_mode(char* name, int follow);
+int fs_is_directory(int mode);
+int fs_mkdir(char* name, int mode);
+int fs_chmod(char* name, int mode);
+int fs_unlink(char* name);
+int fs_remove_tree(char* name);
+int fs_touch(char* name, int create);
+int fs_rename(char* from, char* to);
+int fs_same_device(char* name, char* directory);
+int fs_within(char* name, char* to);
+int fs_symlink(char* target, char* name);
+int fs_link(char* target, char* name);
+int fs_copy(char* from, char* to, int preserve);
+int fs_cat(char* name);
+int fs_same_file(char* a, char* b);
+int fd_same_file(int a, int b);
+int sha256_blocks(unsigned* h, char* data, int count);
+int fs_hash(char* name, char* hex);
+void fs_hash_files(char** names, int count, char** hashes, int* errors);
+int fd_save(int fd);
+int fd_redirect(int fd, int mode, char* name);
+int fd_duplicate(int fd, int source);
+void fd_restore(int fd, int saved);
+int fd_here(int fd, char* text);
+int fd_pipe(int* fds);
+void fd_close(int fd);
+void pipe_signal(int ignore);
+
+/*
+ * Part of a token, as split up by split_variables(). Either literal text,
+ * or a variable (named by text) to be substituted when the command runs.
+ */
+struct Segment
+{
+	int type;
+	char* text;
+	/* The text to use for ${var:-text} when var is not set */
+	char* alternative;
+	/* Used while splitting; where in the token the segment finished */
+	int end;
+	struct Segment* next;
+};
+
+/* A redirection of one of a command's fds, in the order they were given */
+struct Redirect
+{
+	int fd;
+	int mode;
 	/*
-	 * For the token linked-list, this stores the token; for the env linked-list
-	 * this stores the value of the variable.
+	 * The file, or for REDIRECT_DUP the fd it is to be a copy of. For
+	 * REDIRECT_HERE the delimiter, until the body has been read.
 	 */
+	char* target;
+	/* As split by split_variables(); NULL when target has none */
+	struct Segment* segments;
+	/* The delimiter was quoted, so the body is taken as it is */
+	int literal;
+	struct Redirect* next;
+};
+
+/*
+ * A command, compiled from one line of the script. The tokens are as they
+ * appear in the script; segments[i] is NULL when tokens[i] has no variables
+ * in it, which is the usual case.
+ */
+struct Command
+{
+	int kind;
+	int builtin;
+	/* Ended with &, to run in the background */
+	int background;
+	int count;
+	int capacity;
+	char** tokens;
+	struct Segment** segments;
+	/* NULL for none, which is the usual case */
+	struct Redirect* redirects;
+	/* The next command of a pipeline, which reads what this one writes */
+	struct Command* pipe;
+};
+
+/* A whole compiled script */
+struct Program
+{
+	struct Command** commands;
+	int count;
+	int capacity;
+};
+
+/* A SHA-256 in progress; see sha256.c */
+struct SHA256
+{
+	unsigned* h;
+	unsigned* w;
+	char* block;
+	int used;
+	unsigned length_low;
+	unsigned length_high;
+};
+
+struct SHA256* sha256_init();
+void sha256_update(struct SHA256* c, char* data, int length);
+void sha256_string(struct SHA256* c, char* s);
+char* sha256_hex(struct SHA256* c);
+void sha256_free(struct SHA256* c);
+
+/* A region of memory that is all thrown away at once; see arena.c */
+struct ArenaChunk
+{
+	char* memory;
+	int size;
+	int used;
+	struct ArenaChunk* next;
+};
+
+struct Arena
+{
+	struct ArenaChunk* first;
+	struct ArenaChunk* current;
+	struct ArenaChunk* last;
+	int chunk_size;
+	/* Bytes handed out since the last reset, and the most there has been */
+	int used;
+	int peak;
+	/* Bytes taken from the system */
+	int reserved;
+};
+
+struct Arena* arena_new(int chunk_size);
+void* arena_calloc(struct Arena* a, int count, int size);
+void arena_reset(struct Arena* a);
+char* arena_string(struct Arena* a, char* s);
+void arena_report(char* name, struct Arena* a);
+
+/* A string that grows as it is added to; see buffer.c */
+struct Buffer
+{
+	char* text;
+	int length;
+	int capacity;
+	struct Arena* arena;
+};
+
+struct Buffer* buffer_new(struct Arena* a, int capacity);
+void buffer_reserve(struct Buffer* b, int extra);
+void buffer_add_char(struct Buffer* b, int c);
+void buffer_add_range(struct Buffer* b, char* s, int length);
+void buffer_add_string(struct Buffer* b, char* s);
+void buffer_clear(struct Buffer* b);
+
+/* Memory for the line being run; reset once it has been */
+struct Arena* line_arena;
+/* Memory that lives as long as kaem does; the env and such */
+struct Arena* long_arena;
+/* Where compiled commands go: long_arena, or line_arena when streaming */
+struct Arena* compile_arena;
+/* How many commands have been run, and programs started for them, for --stats */
+int commands_run;
+int processes_spawned;
+
+/*
+ * The line being run, with its variables substituted. Contiguous and
+ * NULL terminated, so it goes to the builtins and execve() as it is.
+ */
+char** command_argv;
+int command_argc;
+/* Which command of the program is being run, for the journal */
+int command_index;
+void prepare_command(struct Command* c);
+void show_command(char** argv, int argc, int background);
+void explain_command(char* name, int runs, char* reason);
+void run_command(struct Command* c);
+
+/*
+ * A command as -j sees it; see schedule.c. Everything it points to is in
+ * its own arena, which is kept until its output has been shown.
+ */
+struct Task
+{
+	struct Command* command;
+	/* Where it is in the program */
+	int index;
+	/* What it said it reads and writes, variables filled in */
+	char** inputs;
+	int input_count;
+	char** outputs;
+	int output_count;
+	/* The variables it said its result depends on, besides PATH */
+	char** env_names;
+	int env_count;
+	/* Has to run on its own, with nothing before or after it running */
+	int barrier;
+	int state;
+	int pid;
+	/* Its wait status, once done */
+	int status;
+	/* It was not on PATH */
+	int missing;
+	/* Up to date, so not run at all; see state.c */
+	int skipped;
+	/* Why it runs or not, for --explain */
+	char* reason;
+	/* For state.c; the hashes of argv and of each input before it ran */
+	char* argv_hash;
+	char** input_stamps;
+	char** input_hashes;
+	/* Its output went straight out, -j 1 style, as did -v and --explain */
+	int shown;
+	/* What its result is kept under in STORE_DIR, and if it came from there */
+	char* store_key;
+	int restored;
+	/* Where its stdout and stderr are kept until it is its turn */
+	char* out;
+	char* err;
+	char** argv;
+	int argc;
+	struct Arena* arena;
+	struct Task* next;
+};
+
+void run_parallel(struct Program* p);
+
+/* How a declared command was last run; see state.c */
+struct Record
+{
+	/* Its first output */
+	char* key;
+	char* argv_hash;
+	char* env_hash;
+	int input_count;
+	char** inputs;
+	char** input_stamps;
+	char** input_hashes;
+	int output_count;
+	char** outputs;
+	char** output_stamps;
+	char** output_hashes;
+	/* There is a later record for the same output */
+	int replaced;
+	struct Record* chain;
+	struct Record* next;
+};
+
+/* Commands skipped by state.c, for --stats */
+int commands_skipped;
+void state_load();
+int state_current(struct Task* t);
+void state_record(struct Task* t);
+void state_save();
+char* state_file_hash(char* name);
+char* state_env(struct Task* t);
+
+/* A file that has been hashed, and its stamp at the time */
+struct Hashed
+{
+	char* name;
+	char* stamp;
+	char* hash;
+	struct Hashed* next;
+};
+
+/* Results taken from and put in STORE_DIR, for --stats; see store.c */
+int commands_restored;
+int commands_stored;
+int store_restore(struct Task* t, char* program);
+void store_save(struct Task* t);
+
+/* See jobserver.c */
+void jobserver_start(int serve);
+int jobserver_acquire(int running);
+void jobserver_release(int running);
+
+/* See redirect.c */
+void redirect_target(struct Redirect* r, char* target, int quoted);
+void redirect_body(struct Redirect* r, char* body);
+struct Redirect* redirect_parse(struct Token* n);
+void redirect_restore(int* saved, int count);
+int redirect_count(struct Redirect* r);
+int* redirect_apply(struct Redirect* r);
+
+/* A command started with & that has not been waited for yet; see jobs.c */
+struct Job
+{
+	int pid;
+	/* Its wait status, once done */
+	int status;
+	int done;
+	struct Job* next;
+};
+
+struct Job* jobs;
+/* The pid of the last job started, for ${!}; NULL before there is one */
+char* LAST_JOB;
+void job_start(int pid);
+struct Job* job_find(int pid);
+int job_reap(int* status);
+int job_wait_for(int pid);
+struct Job* job_add(int pid);
+int job_collect(struct Job* j);
+int job_finish(struct Job* j);
+int job_finish_all();
+
+/* One command of a pipeline, while it runs; see pipeline.c */
+struct Stage
+{
+	struct Command* command;
+	char** argv;
+	int argc;
+	int kind;
+	int builtin;
+	/* The ends of the pipes it reads and writes; -1 for kaem's own */
+	int in;
+	int out;
+	/* NULL until it has been started as a program */
+	struct Job* job;
+	/* Its wait status, once done */
+	int status;
+};
+
+int pipeline_run(struct Command* head);
+
+/* See tools.c */
+int tool_code(char* name);
+int run_tool(int tool, char** argv, int argc);
+void tool_error(char* name, char* what, char* file, int error);
+
+/* See journal.c */
+void journal_hash(struct Script* s);
+void journal_begin(int count);
+int journal_finished(int index);
+void journal_done(int index);
+void journal_note(char* kind, char* text);
+/* A variable in the env; see env.c */
+struct Variable
+{
+	/* NAME=value; name and value point into it */
+	char* entry;
+	/* Not NUL terminated */
+	char* name;
+	int name_length;
 	char* value;
-	/*
-	 * Used only for the env linked-list. It holds a string containing the
-	 * name of the var.
-	 */
-	char* var;
-	/* 
-	 * This struct stores a node of a singly linked list, store the pointer to
-	 * the next node.
-	 */
-	struct Token* next;
+	/* The longest value entry has room for; 0 while it is still in envp */
+	int capacity;
+	int hash;
+	/* Unset, but still holding its slot in the table */
+	int removed;
+	/* The order the variables were set in */
+	struct Variable* next;
+	struct Variable* prev;
+};
+
+struct Environment
+{
+	/* Open addressing; capacity is a power of two */
+	struct Variable** slots;
+	int capacity;
+	/* Slots in use, counting removed variables */
+	int used;
+	/* Variables that are set */
+	int count;
+	struct Variable* first;
+	struct Variable* last;
+	/* The envp kaem was started with, until it has been brought in */
+	char** imported;
+	/* The envp for execve(), out of arena; rebuilt when dirty */
+	char** array;
+	int dirty;
+	/* Goes up each time array is rebuilt */
+	int generation;
+	struct Arena* arena;
+};
+
+struct Environment* env_new(int capacity);
+char* env_lookup(char* variable);
+void env_set(char* name, char* value);
+void env_unset(char* name);
+char** env_array();
+void populate_env(char** envp);
+
+/* The environment variables */
+struct Environment* env;
+int env_hash(char* name, int length);
+
+/* A program found on PATH; see path.c */
+struct Executable
+{
+	char* name;
+	char* path;
+	int hash;
+	/* Which of the PATH directories it is in */
+	int directory;
+	/* Times it has been run since it was found */
+	int hits;
+	struct Executable* next;
+};
+
+struct Executables
+{
+	/* Open addressing; capacity is a power of two */
+	struct Executable** slots;
+	int capacity;
+	int count;
+	/* In the order they were found, for the hash builtin */
+	struct Executable* first;
+	struct Executable* last;
+	int hits;
+	int misses;
+	/* PATH, split up */
+	char** directories;
+	int directory_count;
+	/* When each directory last changed, for HASH_CACHE; NULL when unknown */
+	char** stamps;
+	/* Something has been found that HASH_CACHE does not have */
+	int dirty;
+	/* Everything above comes from here, and goes when PATH changes */
+	struct Arena* arena;
 };
 
-/* Token linked-list; stores the tokens of each line */
-struct Token* token;
-/* Env linked-list; stores the environment variables */
-struct Token* env;
+struct Executables* executables;
+void path_reset();
+char* find_executable(char* name);
+void path_save();
@@ -0,0 +1,330 @@
+/* Copyright (C) 2020 fosslinux
+ * This file is part of mescc-tools.
+ *
+ * mescc-tools is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mescc-tools is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mescc-tools.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * EXECUTABLE LOOKUP
+ * PATH is split into its directories once, and again only when PATH is
+ * assigned or unset. Programs found on it are remembered by name in a
+ * small hash table (open addressing, as with the env), so a tool run
+ * thousands of times is only looked for once. Like the hash builtin of
+ * other shells, an entry is trusted until PATH changes or hash -r.
+ *
+ * With HASH_CACHE set, what has been found is also saved to that file,
+ * along with PATH and when each of its directories last changed, so that
+ * the next kaem (quite likely one run by this one) starts off knowing.
+ * An entry from the file is only used if neither its own directory nor
+ * any directory before it on PATH has changed since; anything else is
+ * looked for again. The file looks like:
+ *   kaemPATH01
+ *   PATH
+ *   number of directories in PATH
+ *   a stamp (see file_stamp()) for each of them, one per line
+ *   then for each program: directory number, a tab, its name
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include "kaem.h"
+
+/* HASH_CACHE while it is being read in */
+struct Script* path_cache;
+
+/* Does buffer[start..end) hold exactly s */
+int path_range_is(char* buffer, int start, int end, char* s)
+{
+	int i;
+	for(i = start; i < end; i = i + 1)
+	{
+		if(0 == s[i - start]) return FALSE;
+		if(buffer[i] != s[i - start]) return FALSE;
+	}
+	return 0 == s[end - start];
+}
+
+/* The entry for name, or the empty slot where it would go */
+int path_slot(struct Executables* e, char* name, int hash)
+{
+	int mask = e->capacity - 1;
+	int i = hash & mask;
+	struct Executable* x = e->slots[i];
+	while(NULL != x)
+	{
+		if((hash == x->hash) && match(name, x->name)) return i;
+		i = (i + 1) & mask;
+		x = e->slots[i];
+	}
+	return i;
+}
+
+/* Remember that name was found in the given PATH directory */
+struct Executable* path_remember(struct Executables* e, char* name, int directory, int hash)
+{
+	struct Executable* x = arena_calloc(e->arena, 1, sizeof(struct Executable));
+	struct Buffer* path = buffer_new(e->arena, string_length(e->directories[directory]) + string_length(name) + 1);
+	buffer_add_string(path, e->directories[directory]);
+	buffer_add_char(path, '/');
+	buffer_add_string(path, name);
+	x->name = arena_string(e->arena, name);
+	x->path = path->text;
+	x->directory = directory;
+	x->hash = hash;
+	if(NULL == e->last) e->first = x;
+	else e->last->next = x;
+	e->last = x;
+	e->count = e->count + 1;
+	e->slots[path_slot(e, name, hash)] = x;
+
+	/* Keep at least a quarter of the slots empty, so probes stay short */
+	if((e->count * 4) >= (e->capacity * 3))
+	{
+		e->capacity = e->capacity * 2;
+		e->slots = arena_calloc(e->arena, e->capacity, sizeof(struct Executable*));
+		struct Executable* y;
+		for(y = e->first; NULL != y; y = y->next)
+		{
+			e->slots[path_slot(e, y->name, y->hash)] = y;
+		}
+	}
+	return x;
+}
+
+/* Which directory of PATH name is in, looking in each in turn; -1 for none */
+int path_search(char* name)
+{
+	struct Executables* e = executables;
+	int name_length = string_length(name);
+	struct Buffer* trial = buffer_new(line_arena, 256);
+	int i;
+	for(i = 0; i < e->directory_count; i = i + 1)
+	{
+		buffer_clear(trial);
+		buffer_add_string(trial, e->directories[i]);
+		buffer_add_char(trial, '/');
+		buffer_add_range(trial, name, name_length);
+
+		/* Try the trial */
+		if(is_executable(trial->text)) return i;
+	}
+	return -1;
+}
+
+/* Take in what s (HASH_CACHE, mapped) knows about the current PATH */
+void path_read(struct Script* s)
+{
+	struct Executables* e = executables;
+
+	/* Each line in turn, from start to end (the \n) */
+	int start = 0;
+	int end = scan_char(s->buffer, start, s->length, '\n');
+	if((end >= s->length) || !path_range_is(s->buffer, start, end, "kaemPATH01")) return;
+	start = end + 1;
+	end = scan_char(s->buffer, start, s->length, '\n');
+	if((end >= s->length) || !path_range_is(s->buffer, start, end, PATH)) return;
+	start = end + 1;
+	end = scan_char(s->buffer, start, s->length, '\n');
+	if((end >= s->length) || !path_range_is(s->buffer, start, end, numerate_number(e->directory_count))) return;
+
+	/* Entries are good up to the first directory that has changed */
+	int valid = 0;
+	int i;
+	for(i = 0; i < e->directory_count; i = i + 1)
+	{
+		start = end + 1;
+		end = scan_char(s->buffer, start, s->length, '\n');
+		if(end >= s->length) return;
+		if((valid == i) && path_range_is(s->buffer, start, end, e->stamps[i])) valid = i + 1;
+	}
+
+	int directory;
+	char* name;
+	int hash;
+	int j;
+	while(TRUE)
+	{
+		start = end + 1;
+		end = scan_char(s->buffer, start, s->length, '\n');
+		if(end >= s->length) return;
+		directory = 0;
+		i = start;
+		while((i < end) && ('0' <= s->buffer[i]) && ('9' >= s->buffer[i]))
+		{
+			directory = (directory * 10) + (s->buffer[i] - '0');
+			/* Nothing sensible is that big */
+			if(directory > e->directory_count) break;
+			i = i + 1;
+		}
+		/* Anything that does not look right is dropped; it gets found again */
+		if((i == start) || (i >= end) || ('\t' != s->buffer[i])) continue;
+		if((directory >= valid) || (i + 1 == end)) continue;
+		/* The name is the rest of the line */
+		name = arena_calloc(line_arena, end - i, sizeof(char));
+		for(j = i + 1; j < end; j = j + 1) name[j - i - 1] = s->buffer[j];
+		hash = env_hash(name, end - i - 1);
+		if(NULL == e->slots[path_slot(e, name, hash)]) path_remember(e, name, directory, hash);
+	}
+}
+
+/* Read in what HASH_CACHE knows about the current PATH */
+void path_load()
+{
+	if(NULL == path_cache)
+	{ /* The same one does for every PATH */
+		path_cache = calloc(1, sizeof(struct Script));
+		require(path_cache != NULL, "Memory initialization of hash cache failed\n");
+	}
+	if(FALSE == map_file(path_cache, HASH_CACHE)) return;
+	path_read(path_cache);
+	/* Everything kept has been copied out of it */
+	unmap_file(path_cache);
+}
+
+/* Save what has been found to HASH_CACHE, if there is anything new */
+void path_save()
+{
+	struct Executables* e = executables;
+	if(FALSE == e->dirty) return;
+	e->dirty = FALSE;
+
+	struct Buffer* b = buffer_new(line_arena, 4096);
+	buffer_add_string(b, "kaemPATH01\n");
+	buffer_add_string(b, PATH);
+	buffer_add_char(b, '\n');
+	buffer_add_string(b, numerate_number(e->directory_count));
+	buffer_add_char(b, '\n');
+	int i;
+	for(i = 0; i < e->directory_count; i = i + 1)
+	{
+		buffer_add_string(b, e->stamps[i]);
+		buffer_add_char(b, '\n');
+	}
+	struct Executable* x;
+	for(x = e->first; NULL != x; x = x->next)
+	{
+		buffer_add_string(b, numerate_number(x->directory));
+		buffer_add_char(b, '\t');
+		buffer_add_string(b, x->name);
+		buffer_add_char(b, '\n');
+	}
+
+	/* Written next to it and renamed over it, so no one reads half of it */
+	char* temp = temp_name(HASH_CACHE);
+	if(write_file(temp, b->text, b->length)) replace_file(temp, HASH_CACHE);
+}
+
+/* Forget everything that has been found and split PATH up again */
+void path_reset()
+{
+	if(NULL == executables)
+	{
+		executables = calloc(1, sizeof(struct Executables));
+		require(executables != NULL, "Memory initialization of executables failed\n");
+		executables->arena = arena_new(4096);
+	}
+	struct Executables* e = executables;
+	arena_reset(e->arena);
+	e->capacity = 64;
+	e->slots = arena_calloc(e->arena, e->capacity, sizeof(struct Executable*));
+	e->count = 0;
+	e->first = NULL;
+	e->last = NULL;
+	e->hits = 0;
+	e->misses = 0;
+
+	PATH = env_lookup("PATH");
+	/* Populate USERNAME variable */
+	char* USERNAME = env_lookup("LOGNAME");
+
+	/* Handle edge cases */
+	if((NULL == PATH) && (NULL == USERNAME))
+	{ /* We didn't find either of PATH or USERNAME -- use a generic PATH */
+		PATH = "/root/bin:/usr/local/sbin:/usr/local/bin:/usr/sbin:/usr/bin:/sbin:/bin";
+	}
+	else if(NULL == PATH)
+	{ /* We did find a username but not a PATH -- use a generic PATH but with /home/USERNAME */
+		PATH = prepend_string("/home/", prepend_string(USERNAME,"/bin:/usr/local/bin:/usr/bin:/bin:/usr/local/games:/usr/games"));
+	}
+
+	/* Split it at each : -- there is one more directory than there are :s */
+	int i;
+	int count = 1;
+	for(i = 0; 0 != PATH[i]; i = i + 1)
+	{
+		if(':' == PATH[i]) count = count + 1;
+	}
+	e->directories = arena_calloc(e->arena, count, sizeof(char*));
+	e->directory_count = count;
+	char* copy = arena_string(e->arena, PATH);
+	int start = 0;
+	count = 0;
+	for(i = 0; TRUE; i = i + 1)
+	{
+		if((':' == copy[i]) || (0 == copy[i]))
+		{
+			/* An empty entry means the current directory */
+			if(i == start) e->directories[count] = ".";
+			else e->directories[count] = copy + start;
+			count = count + 1;
+			if(0 == copy[i]) break;
+			copy[i] = 0;
+			start = i + 1;
+		}
+	}
+
+	/* Stamped now, before anything is looked for, so a change while running is caught next time */
+	e->stamps = NULL;
+	e->dirty = FALSE;
+	if(NULL == HASH_CACHE) return;
+	e->stamps = arena_calloc(e->arena, count, sizeof(char*));
+	for(i = 0; i < count; i = i + 1)
+	{
+		e->stamps[i] = file_stamp(e->directories[i]);
+		if(NULL == e->stamps[i])
+		{ /* Nothing can be checked, so nothing is kept */
+			e->stamps = NULL;
+			return;
+		}
+	}
+	path_load();
+}
+
+/* Find the full path to an executable */
+char* find_executable(char* name)
+{
+	if(match("", name)) return NULL;
+	if(('.' == name[0]) || ('/' == name[0]))
+	{ /* assume names that start with . or / are relative or absolute */
+		return name;
+	}
+
+	struct Executables* e = executables;
+	int hash = env_hash(name, string_length(name));
+	struct Executable* x = e->slots[path_slot(e, name, hash)];
+	if(NULL != x)
+	{
+		x->hits = x->hits + 1;
+		e->hits = e->hits + 1;
+		return x->path;
+	}
+
+	e->misses = e->misses + 1;
+	int directory = path_search(name);
+	if(0 > directory) return NULL;
+	x = path_remember(e, name, directory, hash);
+	/* Only worth saving if it can be checked when it is read back */
+	if(NULL != e->stamps) e->dirty = TRUE;
+	return x->path;
+}
@@ -0,0 +1,258 @@
+/* Copyright (C) 2020 fosslinux
+ * This file is part of mescc-tools.
+ *
+ * mescc-tools is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mescc-tools is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mescc-tools.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * PIPELINES
+ * a | b | c runs a, b and c at the same time, each one's stdout going to
+ * the next one's stdin through a pipe. Each has its own redirections,
+ * done after the pipes, so a 2>&1 | b sends a's stderr down the pipe too.
+ * The pipeline's status is that of c, or with set -o pipefail (or
+ * --pipefail) that of the last of them to fail; --strict goes by it.
+ *
+ * One of them may be done by kaem itself: the first builtin (such as
+ * echo), or if there is none, the first of the likes of cat that kaem
+ * can do (see tools.c). The others are started before it, so whatever it
+ * reads from or writes to is already running and it can't get stuck;
+ * cat then has the kernel splice() the data from one end to the other
+ * (see copy_data()). With & every one of them is run as a program, each
+ * a job of its own for wait.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include "kaem.h"
+
+/* Prototypes from other files */
+int execute(int kind, int builtin, int background);
+int command_kind(char* name);
+int builtin_code(char* name);
+
+/* Output a pipeline as it is run, for verbose */
+void pipeline_show(struct Stage** stages, int count, int background)
+{
+	int i;
+	int j;
+	file_print(" +> ", stdout);
+	for(i = 0; i < count; i = i + 1)
+	{
+		if(0 < i) file_print("| ", stdout);
+		for(j = 0; j < stages[i]->argc; j = j + 1)
+		{
+			file_print(stages[i]->argv[j], stdout);
+			file_print(" ", stdout);
+		}
+	}
+	if(background) file_print("&", stdout);
+	fputc('\n', stdout);
+	fflush(stdout);
+}
+
+/* What pipeline_connect() is to put back */
+int pipeline_stdin;
+int pipeline_stdout;
+int* pipeline_saved;
+
+/* Put back the fds pipeline_connect() changed */
+void pipeline_disconnect(struct Stage* s)
+{
+	redirect_restore(pipeline_saved, redirect_count(s->command->redirects));
+	fflush(stdout);
+	if(0 <= s->out) fd_restore(1, pipeline_stdout);
+	if(0 <= s->in) fd_restore(0, pipeline_stdin);
+}
+
+/*
+ * Point stdin and stdout at the pipes s reads and writes, then do its
+ * own redirections. FALSE if one of those couldn't be done, in which case
+ * it has said so and nothing is left changed.
+ */
+int pipeline_connect(struct Stage* s)
+{
+	fflush(stdout);
+	if(0 <= s->in)
+	{
+		pipeline_stdin = fd_save(0);
+		fd_duplicate(0, s->in);
+	}
+	if(0 <= s->out)
+	{
+		pipeline_stdout = fd_save(1);
+		fd_duplicate(1, s->out);
+	}
+	pipeline_saved = NULL;
+	if(NULL == s->command->redirects) return TRUE;
+	pipeline_saved = redirect_apply(s->command->redirects);
+	if(NULL != pipeline_saved) return TRUE;
+	pipeline_disconnect(s);
+	return FALSE;
+}
+
+/*
+ * Start s as a program; its pid, -1 if it couldn't be started, or 0 if
+ * there is no such program (which is not an error without --strict, as
+ * with execute()).
+ */
+int pipeline_spawn(struct Stage* s)
+{
+	int pid;
+	char* program = find_executable(s->argv[0]);
+	if(NULL == program)
+	{
+		if(STRICT == TRUE)
+		{
+			file_print("WHILE EXECUTING ", stderr);
+			file_print(s->argv[0], stderr);
+			file_print(" NOT FOUND!\nABORTING HARD\n", stderr);
+			exit(EXIT_FAILURE);
+		}
+		return 0;
+	}
+	char** envp = env_array();
+	path_save();
+
+	if(FALSE == pipeline_connect(s)) return -1;
+	pid = spawn(program, s->argv, envp);
+	pipeline_disconnect(s);
+	if(-1 == pid)
+	{
+		file_print("WHILE EXECUTING ", stderr);
+		file_print(s->argv[0], stderr);
+		file_print(" execve() FAILED\n", stderr);
+		return -1;
+	}
+	processes_spawned = processes_spawned + 1;
+	return pid;
+}
+
+/* Run a pipeline, head being its first command; its wait status */
+int pipeline_run(struct Command* head)
+{
+	struct Command* c;
+	struct Stage* s;
+	int count = 0;
+	int i;
+	int e;
+	int pid;
+	int status;
+	int fds[2];
+	for(c = head; NULL != c; c = c->pipe) count = count + 1;
+	struct Stage** stages = arena_calloc(line_arena, count, sizeof(struct Stage*));
+	/* The one kaem does itself, if any */
+	int here = -1;
+
+	/* Every one's variables are filled in first, left to right */
+	i = 0;
+	for(c = head; NULL != c; c = c->pipe)
+	{
+		prepare_command(c);
+		s = arena_calloc(line_arena, 1, sizeof(struct Stage));
+		s->command = c;
+		s->argv = command_argv;
+		s->argc = command_argc;
+		s->kind = c->kind;
+		s->builtin = c->builtin;
+		if(COMMAND_UNKNOWN == s->kind)
+		{
+			s->kind = command_kind(command_argv[0]);
+			s->builtin = builtin_code(command_argv[0]);
+		}
+		s->in = -1;
+		s->out = -1;
+		stages[i] = s;
+		i = i + 1;
+	}
+	if(EXPLAIN) explain_command(stages[0]->argv[0], TRUE, "it is a pipeline");
+	if(VERBOSE) pipeline_show(stages, count, head->background);
+	/* Nothing is run when fuzzing */
+	if(FUZZING) return 0;
+
+	if(FALSE == head->background)
+	{ /* The first builtin, or failing that the first of the tools */
+		for(i = 0; (0 > here) && (i < count); i = i + 1)
+		{
+			if(COMMAND_EXTERNAL != stages[i]->kind) here = i;
+		}
+		for(i = 0; (0 > here) && TOOLS && (i < count); i = i + 1)
+		{
+			if(BUILTIN_NONE != stages[i]->builtin) here = i;
+		}
+	}
+
+	for(i = 0; (i + 1) < count; i = i + 1)
+	{
+		e = fd_pipe(fds);
+		if(0 != e)
+		{
+			for(i = 0; i < count; i = i + 1)
+			{
+				fd_close(stages[i]->in);
+				fd_close(stages[i]->out);
+			}
+			fflush(stdout);
+			file_print("kaem: cannot make a pipe: ", stderr);
+			file_print(fs_error(e), stderr);
+			file_print("\n", stderr);
+			return EXIT_FAILURE << 8;
+		}
+		stages[i]->out = fds[1];
+		stages[i + 1]->in = fds[0];
+	}
+
+	/* Everything kaem doesn't do itself is started, left to right */
+	for(i = 0; i < count; i = i + 1)
+	{
+		if(here == i) continue;
+		s = stages[i];
+		pid = pipeline_spawn(s);
+		if(-1 == pid) s->status = EXIT_FAILURE << 8;
+		else if((0 < pid) && head->background) job_start(pid);
+		else if(0 < pid) s->job = job_add(pid);
+		/* It has them now; the next one sees the end of its input once it is done */
+		fd_close(s->in);
+		fd_close(s->out);
+	}
+
+	if(0 <= here)
+	{ /* A write to a pipe nobody reads just fails, rather than killing kaem */
+		s = stages[here];
+		command_argv = s->argv;
+		command_argc = s->argc;
+		s->status = EXIT_FAILURE << 8;
+		if(pipeline_connect(s))
+		{
+			pipe_signal(TRUE);
+			s->status = execute(s->kind, s->builtin, FALSE);
+			pipeline_disconnect(s);
+			pipe_signal(FALSE);
+		}
+		fd_close(s->in);
+		fd_close(s->out);
+	}
+
+	/* Jobs in the background are waited for by wait */
+	if(head->background) return 0;
+	for(i = 0; i < count; i = i + 1)
+	{
+		if(NULL != stages[i]->job) stages[i]->status = job_collect(stages[i]->job);
+	}
+	status = stages[count - 1]->status;
+	for(i = 0; PIPEFAIL && (i < count); i = i + 1)
+	{ /* The last one to fail */
+		if(0 != stages[i]->status) status = stages[i]->status;
+	}
+	return status;
+}
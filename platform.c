@@ -0,0 +1,941 @@
+/* Copyright (C) 2020 fosslinux
+ * This file is part of mescc-tools.
+ *
+ * mescc-tools is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mescc-tools is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mescc-tools.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Platform specific functions for kaem built against a hosted libc.
+ * Every function here has a counterpart in platform_m2.c, which is what
+ * gets used when building with M2-Planet; keep the two in step.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <pthread.h>
+#include <spawn.h>
+#include <linux/fs.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#if defined(__x86_64__)
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+#include "kaem.h"
+
+/*
+ * Map the whole script into memory. Only regular files can be mapped;
+ * anything else returns FALSE so that it gets read as a stream instead.
+ * The mapping is private, so tokens can be written in place without
+ * touching the file itself.
+ */
+int load_script(struct Script* s, FILE* f)
+{
+	struct stat st;
+	void* p;
+	if(0 != fstat(fileno(f), &st)) return FALSE;
+	if(!S_ISREG(st.st_mode)) return FALSE;
+	if(st.st_size > 0x7FFFFFFF) return FALSE;
+
+	s->position = 0;
+	if(0 == st.st_size)
+	{ /* mmap() refuses empty files; there is nothing to tokenize anyway */
+		s->buffer = NULL;
+		s->length = 0;
+		return TRUE;
+	}
+
+	p = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fileno(f), 0);
+	if(MAP_FAILED == p) return FALSE;
+	/* The script is read once, front to back */
+	madvise(p, st.st_size, MADV_SEQUENTIAL);
+	s->buffer = p;
+	s->length = st.st_size;
+	s->capacity = st.st_size;
+	return TRUE;
+}
+
+/* A name to write name's new contents to before moving it into place */
+char* temp_name(char* name)
+{
+	return prepend_string(name, prepend_string(".tmp.", numerate_number(getpid())));
+}
+
+/* Write a whole file in one go */
+int write_file(char* name, char* data, int length)
+{
+	FILE* f = fopen(name, "w");
+	if(NULL == f) return FALSE;
+	int written = fwrite(data, 1, length, f);
+	if(0 != fclose(f)) return FALSE;
+	return written == length;
+}
+
+/* Atomically replace to with from */
+int replace_file(char* from, char* to)
+{
+	if(0 == rename(from, to)) return TRUE;
+	unlink(from);
+	return FALSE;
+}
+
+/* Peak resident set size in KiB, for --stats */
+int peak_memory()
+{
+	struct rusage r;
+	if(0 != getrusage(RUSAGE_SELF, &r)) return -1;
+	return r.ru_maxrss;
+}
+
+/* Whether path is a regular file we may execute; used to search PATH */
+int is_executable(char* path)
+{
+	struct stat st;
+	if(0 != stat(path, &st)) return FALSE;
+	if(!S_ISREG(st.st_mode)) return FALSE;
+	return 0 == access(path, X_OK);
+}
+
+/* Map a file read only; FALSE if it cannot be */
+int map_file(struct Script* s, char* name)
+{
+	struct stat st;
+	void* p;
+	int fd = open(name, O_RDONLY | O_CLOEXEC);
+	if(0 > fd) return FALSE;
+	if((0 != fstat(fd, &st)) || !S_ISREG(st.st_mode) || (0 == st.st_size) || (st.st_size > 0x7FFFFFFF))
+	{
+		close(fd);
+		return FALSE;
+	}
+	p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(MAP_FAILED == p) return FALSE;
+	s->buffer = p;
+	s->length = st.st_size;
+	s->capacity = st.st_size;
+	s->position = 0;
+	return TRUE;
+}
+
+/* Let go of what map_file() gave s */
+void unmap_file(struct Script* s)
+{
+	munmap(s->buffer, s->length);
+	s->buffer = NULL;
+	s->length = 0;
+	s->capacity = 0;
+}
+
+/*
+ * When a file or directory last changed, as a string, so that anything
+ * worked out from it (a cached lookup in it, a hash of it) can be checked.
+ * Missing ones get a stamp too, so that creating one is noticed.
+ */
+char* file_stamp(char* name)
+{
+	struct stat st;
+	char* r;
+	if(0 != stat(name, &st)) return "-";
+	r = calloc(64, sizeof(char));
+	require(r != NULL, "Memory initialization of file stamp failed\n");
+	snprintf(r, 64, "%lld.%09ld:%llu:%lld", (long long)st.st_mtim.tv_sec, (long)st.st_mtim.tv_nsec, (unsigned long long)st.st_ino, (long long)st.st_size);
+	return r;
+}
+
+/* pipe_signal() has kaem ignoring SIGPIPE, and what it did before */
+int pipe_ignoring;
+void (*pipe_handler)(int);
+
+/*
+ * Start program running, returning its pid; -1 if it could not be run.
+ * posix_spawn() shares the parent's memory until the exec (vfork()
+ * style), so unlike fork() it costs the same however big kaem has got.
+ * A child never sees SIGPIPE ignored just because kaem is, for now.
+ */
+int spawn(char* program, char** argv, char** envp)
+{
+	posix_spawnattr_t attributes;
+	sigset_t defaults;
+	pid_t pid;
+	int r;
+	posix_spawnattr_init(&attributes);
+	if(pipe_ignoring && (SIG_IGN != pipe_handler))
+	{
+		sigemptyset(&defaults);
+		sigaddset(&defaults, SIGPIPE);
+		posix_spawnattr_setsigdefault(&attributes, &defaults);
+		posix_spawnattr_setflags(&attributes, POSIX_SPAWN_SETSIGDEF);
+	}
+	r = posix_spawn(&pid, program, NULL, &attributes, argv, envp);
+	posix_spawnattr_destroy(&attributes);
+	if(0 != r) return -1;
+	return pid;
+}
+
+/* How many commands -j runs at once; 0 asks for one per CPU */
+int parallel_jobs(int requested)
+{
+	if(0 < requested) return requested;
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+	if(1 > n) return 1;
+	return n;
+}
+
+/*
+ * spawn(), but with the child's stdout and stderr going to the files out
+ * and err (created, or emptied) rather than wherever kaem's go. With err
+ * NULL both go to out, in the order they were written.
+ */
+int spawn_captured(char* program, char** argv, char** envp, char* out, char* err)
+{
+	posix_spawn_file_actions_t actions;
+	pid_t pid;
+	int r;
+	posix_spawn_file_actions_init(&actions);
+	posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, out, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	if(NULL == err) posix_spawn_file_actions_adddup2(&actions, STDOUT_FILENO, STDERR_FILENO);
+	else posix_spawn_file_actions_addopen(&actions, STDERR_FILENO, err, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	r = posix_spawn(&pid, program, &actions, NULL, argv, envp);
+	posix_spawn_file_actions_destroy(&actions);
+	if(0 != r) return -1;
+	return pid;
+}
+
+/* Copy the file name out to to (unless that is NULL), then delete it */
+int replay_file(char* name, FILE* to)
+{
+	char block[8192];
+	size_t n;
+	FILE* f = fopen(name, "r");
+	if(NULL == f) return FALSE;
+	if(NULL != to)
+	{
+		n = fread(block, 1, sizeof(block), f);
+		while(0 < n)
+		{
+			fwrite(block, 1, n, to);
+			n = fread(block, 1, sizeof(block), f);
+		}
+		fflush(to);
+	}
+	fclose(f);
+	unlink(name);
+	return TRUE;
+}
+
+/* mkdir(); TRUE if the directory is there afterwards */
+int make_directory(char* name)
+{
+	if(0 == mkdir(name, 0777)) return TRUE;
+	return EEXIST == errno;
+}
+
+/* Whether fd is a pipe (or FIFO) */
+int fd_is_pipe(int fd)
+{
+	struct stat st;
+	return (0 == fstat(fd, &st)) && S_ISFIFO(st.st_mode);
+}
+
+/*
+ * Everything left in in, from where it is up to, to out; 0 or the errno.
+ * Within the kernel where it can be: copy_file_range() (which shares
+ * extents on filesystems that can), then sendfile(), or splice() when
+ * either end is a pipe, and read() and write() for the rest. The last is
+ * always had, as files in /proc and the like claim to be empty, and the
+ * others may stop short on them.
+ */
+int copy_data(int in, int out)
+{
+	struct stat st;
+	char block[65536];
+	ssize_t n = -1;
+	ssize_t written;
+	ssize_t w;
+	errno = 0;
+	if((0 == fstat(in, &st)) && S_ISREG(st.st_mode) && (0 < st.st_size))
+	{
+		n = copy_file_range(in, NULL, out, NULL, 1 << 30, 0);
+		while(0 < n) n = copy_file_range(in, NULL, out, NULL, 1 << 30, 0);
+		/* Not between these two files, so the next best thing */
+		if((0 > n) && ((EXDEV == errno) || (EINVAL == errno) || (ENOSYS == errno) || (EOPNOTSUPP == errno) || (EBADF == errno)))
+		{
+			n = sendfile(out, in, NULL, 1 << 30);
+			while(0 < n) n = sendfile(out, in, NULL, 1 << 30);
+			if((0 > n) && ((EINVAL == errno) || (ENOSYS == errno))) n = 0;
+		}
+		if(0 > n) return errno;
+	}
+	else if(fd_is_pipe(in) || fd_is_pipe(out))
+	{ /* Page references move from one to the other, not the data itself */
+		n = splice(in, NULL, out, NULL, 1 << 30, SPLICE_F_MOVE);
+		while(0 < n) n = splice(in, NULL, out, NULL, 1 << 30, SPLICE_F_MOVE);
+		if((0 > n) && ((EINVAL == errno) || (ENOSYS == errno))) n = 0;
+		if(0 > n) return errno;
+	}
+
+	n = read(in, block, sizeof(block));
+	while(0 < n)
+	{
+		for(written = 0; written < n; written = written + w)
+		{
+			w = write(out, block + written, n - written);
+			if(0 > w) return errno;
+		}
+		n = read(in, block, sizeof(block));
+	}
+	if(0 > n) return errno;
+	return 0;
+}
+
+/*
+ * Copy from to to; 0 or the errno. A new to gets from's permissions (less
+ * the umask, unless preserve), an existing one keeps its own. A reflink
+ * (FICLONE) costs nothing where the filesystem can do it; otherwise see
+ * copy_data(). With preserve, the permissions and times are from's.
+ */
+int fs_copy(char* from, char* to, int preserve)
+{
+	struct stat st;
+	struct timespec times[2];
+	int e;
+	int in = open(from, O_RDONLY | O_CLOEXEC);
+	if(0 > in) return errno;
+	if(0 != fstat(in, &st))
+	{
+		e = errno;
+		close(in);
+		return e;
+	}
+	int out = open(to, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, st.st_mode & 0777);
+	if(0 > out)
+	{
+		e = errno;
+		close(in);
+		return e;
+	}
+	e = 0;
+	if(0 != ioctl(out, FICLONE, in)) e = copy_data(in, out);
+	if((0 == e) && preserve)
+	{
+		times[0] = st.st_atim;
+		times[1] = st.st_mtim;
+		if(0 != fchmod(out, st.st_mode & 07777)) e = errno;
+		else if(0 != futimens(out, times)) e = errno;
+	}
+	close(in);
+	if((0 != close(out)) && (0 == e)) e = errno;
+	return e;
+}
+
+/* Copy from to to, keeping its permissions; see fs_copy() */
+int copy_file(char* from, char* to)
+{
+	return 0 == fs_copy(from, to, FALSE);
+}
+
+/*
+ * Write out name (- for stdin) to stdout, as cat does; 0 or the errno, or
+ * -1 if stdout is name (as with cat a >> a), which would never finish.
+ */
+int fs_cat(char* name)
+{
+	struct stat in_st;
+	struct stat out_st;
+	int e;
+	int in = STDIN_FILENO;
+	if(FALSE == match(name, "-")) in = open(name, O_RDONLY | O_CLOEXEC);
+	if(0 > in) return errno;
+	if((0 == fstat(in, &in_st)) && (0 == fstat(STDOUT_FILENO, &out_st)) && S_ISREG(in_st.st_mode)
+	        && (in_st.st_dev == out_st.st_dev) && (in_st.st_ino == out_st.st_ino)
+	        && (lseek(in, 0, SEEK_CUR) < in_st.st_size))
+	{
+		if(STDIN_FILENO != in) close(in);
+		return -1;
+	}
+	e = copy_data(in, STDOUT_FILENO);
+	if(STDIN_FILENO != in) close(in);
+	return e;
+}
+
+/* Both are there and are the same file (or one is a link to the other) */
+int fs_same_file(char* a, char* b)
+{
+	struct stat sa;
+	struct stat sb;
+	if(0 != stat(a, &sa)) return FALSE;
+	if(0 != stat(b, &sb)) return FALSE;
+	return (sa.st_dev == sb.st_dev) && (sa.st_ino == sb.st_ino);
+}
+
+/* fds a and b are open on the same file, as with >log 2>&1 */
+int fd_same_file(int a, int b)
+{
+	struct stat sa;
+	struct stat sb;
+	if(0 != fstat(a, &sa)) return FALSE;
+	if(0 != fstat(b, &sb)) return FALSE;
+	return (sa.st_dev == sb.st_dev) && (sa.st_ino == sb.st_ino);
+}
+
+/*
+ * The read end of a jobserver, either the fifo path or the pipe fd. A
+ * pipe is opened again through /proc where that can be done, so that it
+ * can be made non-blocking without doing the same to everyone else
+ * reading it. -1 if it can't be opened at all.
+ */
+int token_reader(char* path, int fd)
+{
+	char name[32];
+	int r;
+	if(NULL != path) return open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+	if(0 > fcntl(fd, F_GETFD)) return -1;
+	snprintf(name, sizeof(name), "/proc/self/fd/%d", fd);
+	r = open(name, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+	if(0 <= r) return r;
+	/* Settle for it; token_take() polls first, which is nearly always enough */
+	return fd;
+}
+
+/* The write end of a jobserver, as for token_reader() */
+int token_writer(char* path, int fd)
+{
+	if(NULL != path) return open(path, O_WRONLY | O_CLOEXEC);
+	if(0 > fcntl(fd, F_GETFD)) return -1;
+	return fd;
+}
+
+/* A token from the jobserver if there is one to be had right now; -1 if not */
+int token_take(int fd)
+{
+	struct pollfd p;
+	unsigned char c;
+	p.fd = fd;
+	p.events = POLLIN;
+	if(1 != poll(&p, 1, 0)) return -1;
+	if(1 != read(fd, &c, 1)) return -1;
+	return c;
+}
+
+void token_give(int fd, int token)
+{
+	unsigned char c = token;
+	while((1 != write(fd, &c, 1)) && (EINTR == errno))
+	{
+	}
+}
+
+/*
+ * A new jobserver with tokens in it, for children to share: a pipe,
+ * left open across exec. fds gets its read and write ends.
+ */
+int token_pool(int tokens, int* fds)
+{
+	int p[2];
+	if(0 != pipe(p)) return FALSE;
+	fds[0] = p[0];
+	fds[1] = p[1];
+	while(0 < tokens)
+	{
+		token_give(p[1], '+');
+		tokens = tokens - 1;
+	}
+	return TRUE;
+}
+
+/*
+ * The filesystem calls behind the programs kaem can do itself; see
+ * tools.c. Each returns 0, or the errno saying why not.
+ */
+int fs_supported()
+{
+	return TRUE;
+}
+
+char* fs_error(int e)
+{
+	return strerror(e);
+}
+
+int fs_umask()
+{
+	mode_t old = umask(0);
+	umask(old);
+	return old;
+}
+
+/* The mode of name (following symlinks if follow), type bits and all; -1 if it isn't there */
+int fs_mode(char* name, int follow)
+{
+	struct stat st;
+	int r;
+	if(follow) r = stat(name, &st);
+	else r = lstat(name, &st);
+	if(0 != r) return -1;
+	return st.st_mode;
+}
+
+int fs_is_directory(int mode)
+{
+	return (0 <= mode) && S_ISDIR(mode);
+}
+
+int fs_mkdir(char* name, int mode)
+{
+	if(0 == mkdir(name, mode)) return 0;
+	return errno;
+}
+
+int fs_chmod(char* name, int mode)
+{
+	if(0 == chmod(name, mode)) return 0;
+	return errno;
+}
+
+int fs_unlink(char* name)
+{
+	if(0 == unlink(name)) return 0;
+	return errno;
+}
+
+/*
+ * Remove one thing in the tree, saying so if it can't be, as rm does, and
+ * carrying on with the rest. A directory left behind because something
+ * in it was is not said again.
+ */
+int fs_remove_one(const char* name, const struct stat* st, int type, struct FTW* walk)
+{
+	(void)st;
+	(void)walk;
+	if(0 == remove(name)) return 0;
+	if(ENOENT == errno) return 0;
+	if((FTW_DP == type) && ((ENOTEMPTY == errno) || (EEXIST == errno))) return 0;
+	tool_error("rm", "cannot remove", (char*)name, errno);
+	return 0;
+}
+
+/*
+ * Everything in the directory name, depth first, and then name itself;
+ * whatever can't be removed has been reported by the time this returns.
+ * 0, or the errno if name itself can't be looked at.
+ */
+int fs_remove_tree(char* name)
+{
+	int r = nftw(name, fs_remove_one, 16, FTW_DEPTH | FTW_PHYS);
+	if(0 <= r) return r;
+	return errno;
+}
+
+/* Set name's times to now, creating it if it isn't there and create is set */
+int fs_touch(char* name, int create)
+{
+	int fd;
+	if(FALSE == create)
+	{
+		if(0 == utimensat(AT_FDCWD, name, NULL, 0)) return 0;
+		if(ENOENT == errno) return 0;
+		return errno;
+	}
+	fd = open(name, O_WRONLY | O_CREAT | O_NOCTTY | O_NONBLOCK | O_CLOEXEC, 0666);
+	if(0 > fd)
+	{ /* Directories and the like can't be opened to write, but can be touched */
+		if(0 == utimensat(AT_FDCWD, name, NULL, 0)) return 0;
+		return errno;
+	}
+	if(0 != futimens(fd, NULL))
+	{
+		close(fd);
+		return errno;
+	}
+	close(fd);
+	return 0;
+}
+
+int fs_rename(char* from, char* to)
+{
+	if(0 == rename(from, to)) return 0;
+	return errno;
+}
+
+/*
+ * name is a directory that to would be inside of, itself or further down,
+ * which no rename can do. Found by going up from where to would go with
+ * .. until that is name or /.
+ */
+int fs_within(char* name, char* to)
+{
+	struct stat sn;
+	struct stat sd;
+	struct stat up;
+	char path[4096];
+	int length = strlen(to);
+	if((0 != lstat(name, &sn)) || !S_ISDIR(sn.st_mode)) return FALSE;
+	if(length + 3 >= (int)sizeof(path)) return TRUE;
+	memcpy(path, to, length + 1);
+	/* Where to would go is the directory it is in */
+	while((1 < length) && ('/' == path[length - 1])) length = length - 1;
+	while((0 < length) && ('/' != path[length - 1])) length = length - 1;
+	if(0 == length)
+	{
+		path[0] = '.';
+		length = 1;
+	}
+	path[length] = 0;
+	if(0 != stat(path, &sd)) return FALSE;
+	while(TRUE)
+	{
+		if((sd.st_dev == sn.st_dev) && (sd.st_ino == sn.st_ino)) return TRUE;
+		/* Too deep to tell; leave it to mv */
+		if(length + 4 >= (int)sizeof(path)) return TRUE;
+		memcpy(path + length, "/..", 4);
+		length = length + 3;
+		if(0 != stat(path, &up)) return FALSE;
+		if((up.st_dev == sd.st_dev) && (up.st_ino == sd.st_ino)) return FALSE;
+		sd = up;
+	}
+}
+
+/* name (itself, not what it links to) is on the filesystem directory is */
+int fs_same_device(char* name, char* directory)
+{
+	struct stat sn;
+	struct stat sd;
+	/* Whatever is wrong is for fs_rename() to say */
+	if((0 != lstat(name, &sn)) || (0 != stat(directory, &sd))) return TRUE;
+	return sn.st_dev == sd.st_dev;
+}
+
+int fs_symlink(char* target, char* name)
+{
+	if(0 == symlink(target, name)) return 0;
+	return errno;
+}
+
+int fs_link(char* target, char* name)
+{
+	if(0 == link(target, name)) return 0;
+	return errno;
+}
+
+#if defined(__x86_64__)
+/*
+ * SHA-256 with the SHA extensions (SHA-NI), four rounds at a time; see
+ * sha256.c for what it stands in for. The message schedule for each group
+ * of four rounds is worked out three groups ahead, in the four registers
+ * of msg taken in turn. It is optimized even though kaem is built without,
+ * as otherwise every intrinsic goes through memory.
+ */
+unsigned sha256_ni_k[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+__attribute__((target("sha,sse4.1"), optimize("O2")))
+void sha256_ni(unsigned* h, char* data, int count)
+{
+	__m128i msg[4];
+	__m128i shuffle = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+	__m128i state0;
+	__m128i state1;
+	__m128i saved0;
+	__m128i saved1;
+	__m128i m;
+	__m128i t;
+	int g;
+
+	/* From h[0..7] to the ABEF and CDGH the instructions want */
+	t = _mm_shuffle_epi32(_mm_loadu_si128((__m128i*) h), 0xB1);
+	state1 = _mm_shuffle_epi32(_mm_loadu_si128((__m128i*) (h + 4)), 0x1B);
+	state0 = _mm_alignr_epi8(t, state1, 8);
+	state1 = _mm_blend_epi16(state1, t, 0xF0);
+
+	for(; 0 < count; count = count - 1)
+	{
+		saved0 = state0;
+		saved1 = state1;
+		for(g = 0; g < 4; g = g + 1)
+		{
+			msg[g] = _mm_shuffle_epi8(_mm_loadu_si128((__m128i*) (data + (16 * g))), shuffle);
+		}
+		for(g = 0; g < 16; g = g + 1)
+		{
+			m = _mm_add_epi32(msg[g & 3], _mm_loadu_si128((__m128i*) (sha256_ni_k + (4 * g))));
+			state1 = _mm_sha256rnds2_epu32(state1, state0, m);
+			if((3 <= g) && (15 > g))
+			{
+				t = _mm_alignr_epi8(msg[g & 3], msg[(g + 3) & 3], 4);
+				msg[(g + 1) & 3] = _mm_sha256msg2_epu32(_mm_add_epi32(msg[(g + 1) & 3], t), msg[g & 3]);
+			}
+			state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(m, 0x0E));
+			if((1 <= g) && (13 > g)) msg[(g + 3) & 3] = _mm_sha256msg1_epu32(msg[(g + 3) & 3], msg[g & 3]);
+		}
+		state0 = _mm_add_epi32(state0, saved0);
+		state1 = _mm_add_epi32(state1, saved1);
+		data = data + 64;
+	}
+
+	t = _mm_shuffle_epi32(state0, 0x1B);
+	state1 = _mm_shuffle_epi32(state1, 0xB1);
+	_mm_storeu_si128((__m128i*) h, _mm_blend_epi16(t, state1, 0xF0));
+	_mm_storeu_si128((__m128i*) (h + 4), _mm_alignr_epi8(state1, t, 8));
+}
+#endif
+
+/* -1 until the CPU has been asked, then whether it has SHA-NI */
+int sha256_ni_present = -1;
+
+/*
+ * Run count whole blocks of data through the hash h, if the CPU has
+ * instructions for it; how many were done, so 0 leaves it to sha256.c.
+ */
+int sha256_blocks(unsigned* h, char* data, int count)
+{
+#if defined(__x86_64__)
+	unsigned a;
+	unsigned b;
+	unsigned c;
+	unsigned d;
+	if(-1 == sha256_ni_present)
+	{ /* SHA is bit 29 of EBX for leaf 7; SSSE3 and SSE4.1 are bits 9 and 19 of ECX for leaf 1 */
+		sha256_ni_present = FALSE;
+		if(__get_cpuid_count(7, 0, &a, &b, &c, &d) && (b & (1 << 29))
+		        && __get_cpuid(1, &a, &b, &c, &d) && (c & (1 << 9)) && (c & (1 << 19)))
+		{
+			sha256_ni_present = TRUE;
+		}
+	}
+	if(sha256_ni_present)
+	{
+		sha256_ni(h, data, count);
+		return count;
+	}
+#endif
+	return 0;
+}
+
+/* Hash name into hex (65 bytes, NUL and all); 0 or the errno */
+int fs_hash(char* name, char* hex)
+{
+	struct stat st;
+	char* block;
+	char* p;
+	ssize_t n;
+	off_t done;
+	off_t step;
+	int e = 0;
+	int in = open(name, O_RDONLY | O_CLOEXEC);
+	if(0 > in) return errno;
+	struct SHA256* c = sha256_init();
+	p = MAP_FAILED;
+	if((0 == fstat(in, &st)) && S_ISREG(st.st_mode) && (0 < st.st_size))
+	{ /* Straight from the page cache */
+		p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, in, 0);
+	}
+	if(MAP_FAILED != p)
+	{
+		madvise(p, st.st_size, MADV_SEQUENTIAL);
+		for(done = 0; done < st.st_size; done = done + step)
+		{
+			step = st.st_size - done;
+			if(step > (1 << 30)) step = 1 << 30;
+			sha256_update(c, p + done, step);
+		}
+		munmap(p, st.st_size);
+	}
+	else
+	{ /* Pipes, /proc and the like, in big pieces */
+		block = malloc(1 << 20);
+		require(NULL != block, "Memory initialization of hash buffer failed\n");
+		n = read(in, block, 1 << 20);
+		while(0 < n)
+		{
+			sha256_update(c, block, n);
+			n = read(in, block, 1 << 20);
+		}
+		if(0 > n) e = errno;
+		free(block);
+	}
+	close(in);
+	p = sha256_hex(c);
+	if(0 == e) memcpy(hex, p, 65);
+	free(p);
+	sha256_free(c);
+	return e;
+}
+
+/* What the workers of fs_hash_files() share */
+struct HashWork
+{
+	char** names;
+	char** hashes;
+	int* errors;
+	int count;
+	int next;
+};
+
+void* fs_hash_worker(void* arg)
+{
+	struct HashWork* work = arg;
+	int i = __atomic_fetch_add(&work->next, 1, __ATOMIC_RELAXED);
+	while(i < work->count)
+	{
+		work->errors[i] = fs_hash(work->names[i], work->hashes[i]);
+		i = __atomic_fetch_add(&work->next, 1, __ATOMIC_RELAXED);
+	}
+	return NULL;
+}
+
+/*
+ * Hash count files, as many at once as there are CPUs. Each hashes[i]
+ * (65 bytes) gets the hash of names[i], or errors[i] the errno.
+ */
+void fs_hash_files(char** names, int count, char** hashes, int* errors)
+{
+	struct HashWork work;
+	pthread_t workers[64];
+	int started = 0;
+	int wanted = parallel_jobs(0);
+	int i;
+	if(wanted > count) wanted = count;
+	if(wanted > 64) wanted = 64;
+	/* The round constants are filled in before anything shares them */
+	sha256_free(sha256_init());
+	work.names = names;
+	work.hashes = hashes;
+	work.errors = errors;
+	work.count = count;
+	work.next = 0;
+	/* This thread is one of them */
+	for(i = 1; i < wanted; i = i + 1)
+	{
+		if(0 != pthread_create(&workers[started], NULL, fs_hash_worker, &work)) break;
+		started = started + 1;
+	}
+	fs_hash_worker(&work);
+	for(i = 0; i < started; i = i + 1) pthread_join(workers[i], NULL);
+}
+
+/* A copy of fd to put back with fd_restore(), kept from children; -1 if fd isn't open */
+int fd_save(int fd)
+{
+	return fcntl(fd, F_DUPFD_CLOEXEC, 10);
+}
+
+/* Point fd at name, opened as mode says (see redirect.c); 0 or the errno */
+int fd_redirect(int fd, int mode, char* name)
+{
+	int flags = O_WRONLY | O_CREAT | O_TRUNC;
+	int e;
+	if(REDIRECT_APPEND == mode) flags = O_WRONLY | O_CREAT | O_APPEND;
+	else if(REDIRECT_READ == mode) flags = O_RDONLY;
+	int opened = open(name, flags | O_NOCTTY, 0666);
+	if(0 > opened) return errno;
+	if(opened == fd) return 0;
+	e = 0;
+	if(0 > dup2(opened, fd)) e = errno;
+	close(opened);
+	return e;
+}
+
+/* Make fd a copy of source; 0 or the errno */
+int fd_duplicate(int fd, int source)
+{
+	if(0 > fcntl(source, F_GETFD)) return errno;
+	if(fd == source) return 0;
+	if(0 > dup2(source, fd)) return errno;
+	return 0;
+}
+
+void fd_restore(int fd, int saved)
+{
+	if(0 > saved)
+	{
+		close(fd);
+		return;
+	}
+	dup2(saved, fd);
+	close(saved);
+}
+
+/* Point fd at a file in memory holding text, for a here-document; 0 or the errno */
+int fd_here(int fd, char* text)
+{
+	size_t length = strlen(text);
+	size_t written = 0;
+	ssize_t w;
+	int e = 0;
+	int here = memfd_create("kaem-here-document", 0);
+	if(0 > here) return errno;
+	/* It is all going to memory, so the first write() takes the lot */
+	while(written < length)
+	{
+		w = write(here, text + written, length - written);
+		if(0 > w)
+		{
+			e = errno;
+			break;
+		}
+		written = written + w;
+	}
+	if((0 == e) && (0 > lseek(here, 0, SEEK_SET))) e = errno;
+	if(here == fd) return e;
+	if((0 == e) && (0 > dup2(here, fd))) e = errno;
+	close(here);
+	return e;
+}
+
+/* A pipe, read end then write end, kept from children; 0 or the errno */
+int fd_pipe(int* fds)
+{
+	int p[2];
+	if(0 != pipe2(p, O_CLOEXEC)) return errno;
+	fds[0] = p[0];
+	fds[1] = p[1];
+	return 0;
+}
+
+void fd_close(int fd)
+{
+	if(0 <= fd) close(fd);
+}
+
+/*
+ * Ignore SIGPIPE, or go back to what it was. kaem ignores it while it
+ * does a command of a pipeline itself, so that it isn't killed when the
+ * next one stops reading; the write just fails with EPIPE.
+ */
+void pipe_signal(int ignore)
+{
+	if(ignore == pipe_ignoring) return;
+	pipe_ignoring = ignore;
+	if(ignore) pipe_handler = signal(SIGPIPE, SIG_IGN);
+	else signal(SIGPIPE, pipe_handler);
+}
@@ -0,0 +1,404 @@
+/* Copyright (C) 2020 fosslinux
+ * This file is part of mescc-tools.
+ *
+ * mescc-tools is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mescc-tools is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mescc-tools.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Platform specific functions for kaem built with M2-Planet.
+ * These are the counterparts of the functions in platform.c, limited to
+ * what the M2-Planet libc provides.
+ */
+
+/* There is no mmap(); read the whole file in once instead */
+int load_script(struct Script* s, FILE* f)
+{
+	int c = fgetc(f);
+	while(EOF != c)
+	{
+		script_append(s, c);
+		c = fgetc(f);
+	}
+	s->position = 0;
+	return TRUE;
+}
+
+/*
+ * Byte at a time versions of the scanning kernels in scan.c; M2-Planet
+ * has neither vector registers nor a way to load a word from a char*.
+ */
+int scan_token(char* buffer, int position, int length)
+{
+	int c;
+	while(position < length)
+	{
+		c = buffer[position];
+		if((' ' == c) || ('\t' == c) || ('\n' == c)) return position;
+		if(('"' == c) || ('#' == c) || ('\\' == c) || (0 == c)) return position;
+		position = position + 1;
+	}
+	return length;
+}
+
+int scan_char(char* buffer, int position, int length, int c)
+{
+	while(position < length)
+	{
+		if(c == buffer[position]) return position;
+		position = position + 1;
+	}
+	return length;
+}
+
+/*
+ * There is no rename() either, so files are written where they belong.
+ * Anything reading them back has to cope with finding half a file.
+ */
+char* temp_name(char* name)
+{
+	return name;
+}
+
+int write_file(char* name, char* data, int length)
+{
+	FILE* f = fopen(name, "w");
+	if(NULL == f) return FALSE;
+	int i;
+	for(i = 0; i < length; i = i + 1)
+	{
+		fputc(data[i], f);
+	}
+	fclose(f);
+	return TRUE;
+}
+
+int replace_file(char* from, char* to)
+{
+	return match(from, to);
+}
+
+/* Nothing to ask the kernel with */
+int peak_memory()
+{
+	return -1;
+}
+
+/* No stat() or access(); settle for being able to open it */
+int is_executable(char* path)
+{
+	FILE* t = fopen(path, "r");
+	if(NULL == t) return FALSE;
+	fclose(t);
+	return TRUE;
+}
+
+/* No mmap(); read it in */
+int map_file(struct Script* s, char* name)
+{
+	FILE* f = fopen(name, "r");
+	if(NULL == f) return FALSE;
+	load_script(s, f);
+	fclose(f);
+	return TRUE;
+}
+
+void unmap_file(struct Script* s)
+{
+	free(s->buffer);
+	s->buffer = NULL;
+	s->length = 0;
+	s->capacity = 0;
+}
+
+/* No stat(), so nothing cached can be checked; so nothing is cached */
+char* file_stamp(char* name)
+{
+	return NULL;
+}
+
+/* Only fork() to be had */
+int spawn(char* program, char** argv, char** envp)
+{
+	int f = fork();
+	/* Ensure fork succeeded */
+	if(f == -1)
+	{
+		file_print("WHILE EXECUTING ", stderr);
+		file_print(argv[0], stderr);
+		file_print(" fork() FAILED\nABORTING HARD\n", stderr);
+		exit(EXIT_FAILURE);
+	}
+	else if(f == 0)
+	{ /* Child */
+		/* execve() returns only on error */
+		execve(program, argv, envp);
+		file_print("WHILE EXECUTING ", stderr);
+		file_print(argv[0], stderr);
+		file_print(" execve() FAILED\n", stderr);
+		_exit(EXIT_FAILURE);
+	}
+	return f;
+}
+
+/*
+ * Without dup2() or posix_spawn() there is no sending a child's output
+ * anywhere but where kaem's goes, so it can't be put back in order; -j
+ * runs one command at a time.
+ */
+int parallel_jobs(int requested)
+{
+	return 1;
+}
+
+int spawn_captured(char* program, char** argv, char** envp, char* out, char* err)
+{
+	return spawn(program, argv, envp);
+}
+
+int replay_file(char* name, FILE* to)
+{
+	return FALSE;
+}
+
+/* No mkdir(); whatever needs a directory has to do without */
+int make_directory(char* name)
+{
+	return FALSE;
+}
+
+/* A byte at a time, and without its permissions */
+int copy_file(char* from, char* to)
+{
+	FILE* in = fopen(from, "r");
+	if(NULL == in) return FALSE;
+	FILE* out = fopen(to, "w");
+	if(NULL == out)
+	{
+		fclose(in);
+		return FALSE;
+	}
+	int c = fgetc(in);
+	while(EOF != c)
+	{
+		fputc(c, out);
+		c = fgetc(in);
+	}
+	fclose(in);
+	fclose(out);
+	return TRUE;
+}
+
+/* No pipes to be had, and -j is one at a time anyway; so no jobserver */
+int token_reader(char* path, int fd)
+{
+	return -1;
+}
+
+int token_writer(char* path, int fd)
+{
+	return -1;
+}
+
+int token_take(int fd)
+{
+	return -1;
+}
+
+void token_give(int fd, int token)
+{
+}
+
+int token_pool(int tokens, int* fds)
+{
+	return FALSE;
+}
+
+/* None of the calls for tools.c are to be had; the programs are run instead */
+int fs_supported()
+{
+	return FALSE;
+}
+
+char* fs_error(int e)
+{
+	return "failed";
+}
+
+int fs_umask()
+{
+	return 18;
+}
+
+int fs_mode(char* name, int follow)
+{
+	return -1;
+}
+
+int fs_is_directory(int mode)
+{
+	return FALSE;
+}
+
+int fs_mkdir(char* name, int mode)
+{
+	return -1;
+}
+
+int fs_chmod(char* name, int mode)
+{
+	return -1;
+}
+
+int fs_unlink(char* name)
+{
+	return -1;
+}
+
+
+int fs_remove_tree(char* name)
+{
+	return -1;
+}
+
+int fs_touch(char* name, int create)
+{
+	return -1;
+}
+
+int fs_rename(char* from, char* to)
+{
+	return -1;
+}
+
+int fs_within(char* name, char* to)
+{
+	return FALSE;
+}
+
+int fs_same_device(char* name, char* directory)
+{
+	return TRUE;
+}
+
+int fs_symlink(char* target, char* name)
+{
+	return -1;
+}
+
+int fs_link(char* target, char* name)
+{
+	return -1;
+}
+
+int fs_copy(char* from, char* to, int preserve)
+{
+	return -1;
+}
+
+int fs_cat(char* name)
+{
+	return -1;
+}
+
+int fs_same_file(char* a, char* b)
+{
+	return FALSE;
+}
+
+int fd_same_file(int a, int b)
+{
+	return FALSE;
+}
+
+/* The portable code in sha256.c does every block */
+int sha256_blocks(unsigned* h, char* data, int count)
+{
+	return 0;
+}
+
+/* No mmap(); a byte at a time, a block at a time into the hash */
+int fs_hash(char* name, char* hex)
+{
+	FILE* f = fopen(name, "r");
+	if(NULL == f) return ERROR_NOENT;
+	char* block = calloc(4096, sizeof(char));
+	require(block != NULL, "Memory initialization of hash buffer failed\n");
+	struct SHA256* h = sha256_init();
+	int used = 0;
+	int c = fgetc(f);
+	while(EOF != c)
+	{
+		block[used] = c;
+		used = used + 1;
+		if(4096 == used)
+		{
+			sha256_update(h, block, used);
+			used = 0;
+		}
+		c = fgetc(f);
+	}
+	sha256_update(h, block, used);
+	fclose(f);
+	char* p = sha256_hex(h);
+	copy_string(hex, p);
+	free(p);
+	free(block);
+	sha256_free(h);
+	return 0;
+}
+
+void fs_hash_files(char** names, int count, char** hashes, int* errors)
+{
+	int i;
+	for(i = 0; i < count; i = i + 1) errors[i] = fs_hash(names[i], hashes[i]);
+}
+
+/* No redirections; each one fails */
+int fd_save(int fd)
+{
+	return -1;
+}
+
+int fd_redirect(int fd, int mode, char* name)
+{
+	return -1;
+}
+
+int fd_duplicate(int fd, int source)
+{
+	return -1;
+}
+
+void fd_restore(int fd, int saved)
+{
+}
+
+int fd_here(int fd, char* text)
+{
+	return -1;
+}
+
+/* No pipes either, so no pipelines */
+int fd_pipe(int* fds)
+{
+	return -1;
+}
+
+void fd_close(int fd)
+{
+}
+
+void pipe_signal(int ignore)
+{
+}
@@ -0,0 +1,197 @@
+/* Copyright (C) 2020 fosslinux
+ * This file is part of mescc-tools.
+ *
+ * mescc-tools is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mescc-tools is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mescc-tools.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * REDIRECTIONS
+ * A word starting with >, >> or < (or the fd it is for and then one of
+ * those, as in 2>) redirects the command to the file named by the
+ * rest of the word, or by the next word. >&N and <&N make it a copy of fd
+ * N instead, as in 2>&1. They are done in order, left to right. The
+ * operator itself can't be quoted, but the file can be.
+ *
+ * <<EOF makes stdin (or N, with N<<EOF) a here-document: the lines after
+ * the command, up to one that is just EOF. Its variables are filled in
+ * as the command runs, unless EOF was quoted ("EOF" or 'EOF'), and it is
+ * put in a file in memory with one write(). So cat <<EOF > file writes
+ * out a file without anything being run at all (see tools.c).
+ *
+ * kaem sets them up itself for as long as the command runs: the fds are
+ * saved, pointed at the files and put back afterwards. So a program gets
+ * them just as it gets everything else from kaem, and builtins like echo
+ * and pwd (and the likes of cat, see tools.c) write straight to them.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include "kaem.h"
+
+/* Prototypes from other files */
+struct Segment* split_variables(char* input);
+char* expand_variables(struct Segment* head);
+
+/* Say where r goes, or for a here-document what ends it */
+void redirect_target(struct Redirect* r, char* target, int quoted)
+{
+	int last;
+	r->target = target;
+	if(REDIRECT_HERE != r->mode)
+	{ /* Variables in it are filled in when the command runs, as for its arguments */
+		r->segments = split_variables(target);
+		return;
+	}
+	r->literal = quoted;
+	/* kaem has no '' strings, but it is how here-documents are usually quoted */
+	last = string_length(target) - 1;
+	if((0 < last) && ('\'' == target[0]) && ('\'' == target[last]))
+	{
+		target[last] = 0;
+		r->target = target + 1;
+		r->literal = TRUE;
+	}
+}
+
+/* Give a here-document the body that was read for it */
+void redirect_body(struct Redirect* r, char* body)
+{
+	r->target = body;
+	r->segments = NULL;
+	if(FALSE == r->literal) r->segments = split_variables(body);
+}
+
+/* The redirection n starts, without its file if n is just the operator; NULL if it isn't one */
+struct Redirect* redirect_parse(struct Token* n)
+{
+	struct Redirect* r;
+	char* word = n->value;
+	int i = 0;
+	int fd = -1;
+	int mode;
+	if(in_set(word[0], "0123456789") && in_set(word[1], "<>"))
+	{
+		fd = word[0] - '0';
+		i = 1;
+	}
+	if('>' == word[i])
+	{
+		mode = REDIRECT_WRITE;
+		if(0 > fd) fd = 1;
+		i = i + 1;
+		if('>' == word[i]) mode = REDIRECT_APPEND;
+		else if('&' == word[i]) mode = REDIRECT_DUP;
+		if(REDIRECT_WRITE != mode) i = i + 1;
+	}
+	else if('<' == word[i])
+	{
+		mode = REDIRECT_READ;
+		if(0 > fd) fd = 0;
+		i = i + 1;
+		if('&' == word[i]) mode = REDIRECT_DUP;
+		else if('<' == word[i]) mode = REDIRECT_HERE;
+		if(REDIRECT_READ != mode) i = i + 1;
+	}
+	else return NULL;
+	/* ">" and the like are just arguments */
+	if(i > n->unquoted) return NULL;
+
+	r = arena_calloc(compile_arena, 1, sizeof(struct Redirect));
+	r->fd = fd;
+	r->mode = mode;
+	if(0 != word[i]) redirect_target(r, word + i, n->quoted);
+	return r;
+}
+
+/* Report a redirection that couldn't be done */
+void redirect_error(char* target, int error)
+{
+	fflush(stdout);
+	file_print("kaem: cannot redirect to ", stderr);
+	file_print(target, stderr);
+	file_print(": ", stderr);
+	file_print(fs_error(error), stderr);
+	file_print("\n", stderr);
+}
+
+/*
+ * Put back what redirect_apply() saved: pairs of an fd and the copy of
+ * what it was, count of them, last first.
+ */
+void redirect_restore(int* saved, int count)
+{
+	int i;
+	if(NULL == saved) return;
+	/* Whatever builtins wrote goes where it was meant to */
+	fflush(stdout);
+	fflush(stderr);
+	for(i = count - 1; 0 <= i; i = i - 1) fd_restore(saved[2 * i], saved[(2 * i) + 1]);
+}
+
+/* How many fds redirect_apply() saved for r */
+int redirect_count(struct Redirect* r)
+{
+	int count = 0;
+	for(; NULL != r; r = r->next) count = count + 1;
+	return count;
+}
+
+/*
+ * Point the command's fds where r says, saving what they were for
+ * redirect_restore(); NULL if one couldn't be done, in which case it has
+ * said why and nothing is left changed.
+ */
+int* redirect_apply(struct Redirect* r)
+{
+	int i;
+	int j;
+	int e;
+	int source;
+	char* target;
+	struct Redirect* each;
+	int* saved = arena_calloc(line_arena, 2 * redirect_count(r), sizeof(int));
+
+	/* What kaem has printed so far goes where it always did */
+	fflush(stdout);
+	fflush(stderr);
+	i = 0;
+	for(each = r; NULL != each; each = each->next)
+	{
+		target = each->target;
+		if(NULL != each->segments) target = expand_variables(each->segments);
+		saved[2 * i] = each->fd;
+		saved[(2 * i) + 1] = fd_save(each->fd);
+		i = i + 1;
+		if(REDIRECT_HERE == each->mode)
+		{ /* Its body isn't much of a name to give if it fails */
+			e = fd_here(each->fd, target);
+			target = "a here-document";
+		}
+		else if(REDIRECT_DUP == each->mode)
+		{ /* Only a plain number will do */
+			source = 0;
+			for(j = 0; in_set(target[j], "0123456789"); j = j + 1) source = (source * 10) + (target[j] - '0');
+			e = ERROR_BADF;
+			if((0 < j) && (0 == target[j])) e = fd_duplicate(each->fd, source);
+		}
+		else e = fd_redirect(each->fd, each->mode, target);
+		if(0 != e)
+		{
+			redirect_restore(saved, i);
+			redirect_error(target, e);
+			return NULL;
+		}
+	}
+	return saved;
+}
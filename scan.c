@@ -0,0 +1,164 @@
+/* Copyright (C) 2020 fosslinux
+ * This file is part of mescc-tools.
+ *
+ * mescc-tools is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mescc-tools is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mescc-tools.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Scanning kernels for the tokenizer, hosted libc build only.
+ * platform_m2.c has the plain byte at a time versions used by M2-Planet.
+ *
+ * scan_token() finds the next byte that the tokenizer has to look at:
+ * space, tab, newline, ", #, \ or NUL. Everything before it is just
+ * part of the token. scan_char() finds the next occurrence of one byte.
+ * Both return length when there is nothing left to find.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__) && defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+/* The slow path, for the tail and anything too short for a full word */
+static int scan_token_bytes(char* buffer, int position, int length)
+{
+	char c;
+	while(position < length)
+	{
+		c = buffer[position];
+		if((' ' == c) || ('\t' == c) || ('\n' == c) || ('"' == c) || ('#' == c) || ('\\' == c) || (0 == c))
+		{
+			return position;
+		}
+		position = position + 1;
+	}
+	return length;
+}
+
+#if defined(__x86_64__) && defined(__SSE2__)
+
+/* One bit per byte of the 16 at p that is a token delimiter */
+static inline int delimiters_sse2(char* p)
+{
+	__m128i v = _mm_loadu_si128((__m128i*)p);
+	__m128i hit = _mm_cmpeq_epi8(v, _mm_set1_epi8(' '));
+	hit = _mm_or_si128(hit, _mm_cmpeq_epi8(v, _mm_set1_epi8('\t')));
+	hit = _mm_or_si128(hit, _mm_cmpeq_epi8(v, _mm_set1_epi8('\n')));
+	hit = _mm_or_si128(hit, _mm_cmpeq_epi8(v, _mm_set1_epi8('"')));
+	hit = _mm_or_si128(hit, _mm_cmpeq_epi8(v, _mm_set1_epi8('#')));
+	hit = _mm_or_si128(hit, _mm_cmpeq_epi8(v, _mm_set1_epi8('\\')));
+	hit = _mm_or_si128(hit, _mm_cmpeq_epi8(v, _mm_setzero_si128()));
+	return _mm_movemask_epi8(hit);
+}
+
+static int scan_token_sse2(char* buffer, int position, int length)
+{
+	int mask;
+	while(position + 16 <= length)
+	{
+		mask = delimiters_sse2(buffer + position);
+		if(0 != mask) return position + __builtin_ctz(mask);
+		position = position + 16;
+	}
+	return scan_token_bytes(buffer, position, length);
+}
+
+__attribute__((target("avx2")))
+static int scan_token_avx2(char* buffer, int position, int length)
+{
+	__m256i v;
+	__m256i hit;
+	unsigned mask;
+	while(position + 32 <= length)
+	{
+		v = _mm256_loadu_si256((__m256i*)(buffer + position));
+		hit = _mm256_cmpeq_epi8(v, _mm256_set1_epi8(' '));
+		hit = _mm256_or_si256(hit, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t')));
+		hit = _mm256_or_si256(hit, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')));
+		hit = _mm256_or_si256(hit, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('"')));
+		hit = _mm256_or_si256(hit, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('#')));
+		hit = _mm256_or_si256(hit, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\')));
+		hit = _mm256_or_si256(hit, _mm256_cmpeq_epi8(v, _mm256_setzero_si256()));
+		mask = _mm256_movemask_epi8(hit);
+		if(0 != mask) return position + __builtin_ctz(mask);
+		position = position + 32;
+	}
+	return scan_token_sse2(buffer, position, length);
+}
+
+/* 0 until checked, then 1 for SSE2 only or 2 when AVX2 is usable */
+static int scan_level;
+
+int scan_token(char* buffer, int position, int length)
+{
+	/* Most tokens are short; don't bother setting up vectors for them */
+	if(position + 16 > length) return scan_token_bytes(buffer, position, length);
+	if(0 == scan_level)
+	{
+		__builtin_cpu_init();
+		if(__builtin_cpu_supports("avx2")) scan_level = 2;
+		else scan_level = 1;
+	}
+	if(2 == scan_level) return scan_token_avx2(buffer, position, length);
+	return scan_token_sse2(buffer, position, length);
+}
+
+#else
+
+/*
+ * Word at a time (SWAR) scan for everything else. A byte of x is zero
+ * exactly when the matching byte of has_zero(x) has its top bit set, at
+ * least up to the first zero byte, which is all that is needed here.
+ */
+#define ONES 0x0101010101010101ULL
+#define HIGHS 0x8080808080808080ULL
+static inline uint64_t has_zero(uint64_t x)
+{
+	return (x - ONES) & ~x & HIGHS;
+}
+
+int scan_token(char* buffer, int position, int length)
+{
+	uint64_t w;
+	uint64_t hit;
+	while(position + 8 <= length)
+	{
+		memcpy(&w, buffer + position, 8);
+		hit = has_zero(w ^ (ONES * ' '));
+		hit = hit | has_zero(w ^ (ONES * '\t'));
+		hit = hit | has_zero(w ^ (ONES * '\n'));
+		hit = hit | has_zero(w ^ (ONES * '"'));
+		hit = hit | has_zero(w ^ (ONES * '#'));
+		hit = hit | has_zero(w ^ (ONES * '\\'));
+		hit = hit | has_zero(w);
+		/* Let the byte loop pin down exactly which byte it was */
+		if(0 != hit) return scan_token_bytes(buffer, position, length);
+		position = position + 8;
+	}
+	return scan_token_bytes(buffer, position, length);
+}
+
+#endif
+
+int scan_char(char* buffer, int position, int length, int c)
+{
+	char* hit;
+	if(position >= length) return length;
+	/* libc already has a vectorized search for a single byte */
+	hit = memchr(buffer + position, c, length - position);
+	if(NULL == hit) return length;
+	return hit - buffer;
+}
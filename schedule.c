@@ -0,0 +1,490 @@
+/* Copyright (C) 2020 fosslinux
+ * This file is part of mescc-tools.
+ *
+ * mescc-tools is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mescc-tools is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mescc-tools.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * PARALLEL SCHEDULING
+ * With -j, commands that say what they read and write run side by side.
+ * They say so on the lines just before them:
+ *   @in hello.c hello.h
+ *   @out hello.o
+ *   cc -c hello.c -o hello.o
+ * A declared command only waits for the earlier commands that write what
+ * it reads, or that read or write what it writes. Names are compared as
+ * they are written, so hello.o and ./hello.o are different files as far
+ * as this is concerned. Everything else (builtins, assignments, commands
+ * run with &, redirected or piped, and commands that declare nothing) is
+ * a barrier: it waits for everything before it, and nothing after it
+ * starts until it is done.
+ * Variables in declarations are filled in once the barriers before them
+ * have run, just as they would be running the script in order.
+ * A command that depends on more of the env than PATH says which with
+ *   @env CC CFLAGS
+ * which --state and --store take into account; nothing else does.
+ *
+ * Each command's stdout and stderr go to files of their own (or to one
+ * file, when kaem's own go to the same place, as with >log 2>&1), which
+ * are copied out in script order once it has finished; the output looks
+ * the same as it would have one command at a time. --strict stops at the
+ * first failure in script order too, though commands after it may have
+ * been run already. With -j 1 (which is what --state and --explain get
+ * without -j) a command is only started once everything before it has
+ * been shown, so its output goes straight out (unless --store needs it).
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include "kaem.h"
+
+#define TASK_WAITING 0
+//CONSTANT TASK_WAITING 0
+#define TASK_RUNNING 1
+//CONSTANT TASK_RUNNING 1
+#define TASK_DONE 2
+//CONSTANT TASK_DONE 2
+
+/* How far ahead of the first unfinished command to look, per job */
+#define TASK_LOOKAHEAD 16
+//CONSTANT TASK_LOOKAHEAD 16
+
+/* Commands in script order, from the first whose output is not shown yet */
+struct Task* window;
+struct Task* window_last;
+int window_count;
+/* Done with, to be used again along with their arenas */
+struct Task* spare_tasks;
+/* The next command in the program to go in the window */
+int schedule_position;
+/* Makes the names of the output files unique */
+int tasks_started;
+int tasks_running;
+
+struct Task* task_new()
+{
+	struct Task* t = spare_tasks;
+	struct Arena* a;
+	if(NULL == t)
+	{
+		t = calloc(1, sizeof(struct Task));
+		require(t != NULL, "Memory initialization of task failed\n");
+		t->arena = arena_new(4096);
+		return t;
+	}
+	spare_tasks = t->next;
+	a = t->arena;
+	arena_reset(a);
+	t->command = NULL;
+	t->inputs = NULL;
+	t->input_count = 0;
+	t->outputs = NULL;
+	t->output_count = 0;
+	t->env_names = NULL;
+	t->env_count = 0;
+	t->barrier = FALSE;
+	t->state = TASK_WAITING;
+	t->pid = 0;
+	t->status = 0;
+	t->missing = FALSE;
+	t->skipped = FALSE;
+	t->reason = NULL;
+	t->argv_hash = NULL;
+	t->input_stamps = NULL;
+	t->input_hashes = NULL;
+	t->shown = FALSE;
+	t->store_key = NULL;
+	t->restored = FALSE;
+	t->out = NULL;
+	t->err = NULL;
+	t->argv = NULL;
+	t->argc = 0;
+	t->next = NULL;
+	return t;
+}
+
+/* Add the names in command_argv after the @in, @out or @env to names */
+char** task_declare(struct Task* t, char** names, int count)
+{
+	char** r = arena_calloc(t->arena, count + command_argc, sizeof(char*));
+	int i;
+	for(i = 0; i < count; i = i + 1) r[i] = names[i];
+	for(i = 1; i < command_argc; i = i + 1) r[count + i - 1] = command_argv[i];
+	return r;
+}
+
+/* The next command in the program, with what it declared; NULL at the end */
+struct Task* task_next(struct Program* p)
+{
+	struct Task* t = task_new();
+	struct Arena* saved = line_arena;
+	struct Command* c;
+	int declared = FALSE;
+	line_arena = t->arena;
+	while(schedule_position < p->count)
+	{
+		c = p->commands[schedule_position];
+		schedule_position = schedule_position + 1;
+		if(journal_finished(schedule_position - 1))
+		{ /* Along with whatever it declared */
+			t->inputs = NULL;
+			t->input_count = 0;
+			t->outputs = NULL;
+			t->output_count = 0;
+			t->env_names = NULL;
+			t->env_count = 0;
+			declared = FALSE;
+			continue;
+		}
+		if(COMMAND_DECLARE != c->kind)
+		{
+			t->command = c;
+			t->index = schedule_position - 1;
+			break;
+		}
+
+		declared = TRUE;
+		prepare_command(c);
+		if(match(command_argv[0], "@in"))
+		{
+			t->inputs = task_declare(t, t->inputs, t->input_count);
+			t->input_count = t->input_count + command_argc - 1;
+		}
+		else if(match(command_argv[0], "@out"))
+		{
+			t->outputs = task_declare(t, t->outputs, t->output_count);
+			t->output_count = t->output_count + command_argc - 1;
+		}
+		else
+		{
+			t->env_names = task_declare(t, t->env_names, t->env_count);
+			t->env_count = t->env_count + command_argc - 1;
+		}
+	}
+	line_arena = saved;
+
+	if(NULL == t->command)
+	{ /* Declarations with nothing after them */
+		t->next = spare_tasks;
+		spare_tasks = t;
+		return NULL;
+	}
+	t->barrier = (FALSE == declared) || (COMMAND_EXTERNAL != t->command->kind) || t->command->background || (NULL != t->command->redirects) || (NULL != t->command->pipe);
+	return t;
+}
+
+/* Look ahead in the program, up to the next barrier */
+void window_fill(struct Program* p)
+{
+	struct Task* t;
+	while(window_count < (JOBS * TASK_LOOKAHEAD))
+	{
+		if((NULL != window_last) && window_last->barrier) return;
+		t = task_next(p);
+		if(NULL == t) return;
+		if(NULL == window) window = t;
+		else window_last->next = t;
+		window_last = t;
+		window_count = window_count + 1;
+	}
+}
+
+/* Take the first task out of the window, once it is done with */
+void window_pop()
+{
+	struct Task* t = window;
+	window = t->next;
+	if(NULL == window) window_last = NULL;
+	window_count = window_count - 1;
+	t->next = spare_tasks;
+	spare_tasks = t;
+}
+
+int task_names_meet(char** a, int a_count, char** b, int b_count)
+{
+	int i;
+	int j;
+	for(i = 0; i < a_count; i = i + 1)
+	{
+		for(j = 0; j < b_count; j = j + 1)
+		{
+			if(match(a[i], b[j])) return TRUE;
+		}
+	}
+	return FALSE;
+}
+
+/* Whether t has to wait for the earlier task u */
+int task_depends(struct Task* t, struct Task* u)
+{
+	if(task_names_meet(t->inputs, t->input_count, u->outputs, u->output_count)) return TRUE;
+	if(task_names_meet(t->outputs, t->output_count, u->outputs, u->output_count)) return TRUE;
+	return task_names_meet(t->outputs, t->output_count, u->inputs, u->input_count);
+}
+
+/* Whether everything t waits for has finished */
+int task_ready(struct Task* t)
+{
+	struct Task* u;
+	for(u = window; u != t; u = u->next)
+	{
+		if((TASK_DONE != u->state) && task_depends(t, u)) return FALSE;
+	}
+	return TRUE;
+}
+
+/* Where the task's output goes until its turn */
+char* task_output_name(char* suffix)
+{
+	char* directory = env_lookup("TMPDIR");
+	if(NULL == directory) directory = "/tmp";
+	char* name = prepend_string(directory, prepend_string("/kaem-job-", numerate_number(tasks_started)));
+	return arena_string(line_arena, temp_name(prepend_string(name, suffix)));
+}
+
+/* Note that t has finished successfully, wherever that needs noting */
+void task_finished(struct Task* t)
+{
+	if(FALSE == t->restored) store_save(t);
+	state_record(t);
+	journal_done(t->index);
+}
+
+/* Say what is about to be run, for -v and --explain */
+void task_show(struct Task* t)
+{
+	t->shown = TRUE;
+	if(EXPLAIN && (NULL != t->reason)) explain_command(t->argv[0], FALSE == t->skipped, t->reason);
+	if(VERBOSE && (FALSE == t->skipped)) show_command(t->argv, t->argc, FALSE);
+}
+
+/* Fill in the command's variables and start it running */
+void task_start(struct Task* t)
+{
+	struct Arena* saved = line_arena;
+	line_arena = t->arena;
+	prepare_command(t->command);
+	t->argv = command_argv;
+	t->argc = command_argc;
+	t->state = TASK_DONE;
+
+	if(((NULL != STATE_FILE) || EXPLAIN || (NULL != STORE_DIR)) && state_current(t))
+	{ /* Nothing to do */
+		t->skipped = TRUE;
+		line_arena = saved;
+		journal_done(t->index);
+		return;
+	}
+	int tool = tool_code(t->argv[0]);
+	if((BUILTIN_NONE != tool) && (1 == JOBS) && (NULL == STORE_DIR) && (FALSE == FUZZING))
+	{ /* Done here and now, as run_command() would; nothing is captured to do it later */
+		task_show(t);
+		t->status = run_tool(tool, t->argv, t->argc);
+		if(0 <= t->status)
+		{
+			t->status = t->status << 8;
+			line_arena = saved;
+			if(0 == t->status) task_finished(t);
+			return;
+		}
+		t->status = 0;
+	}
+	char* program = find_executable(t->argv[0]);
+	if(NULL == program)
+	{ /* Said so when it is its turn */
+		t->missing = TRUE;
+		line_arena = saved;
+		return;
+	}
+	char** envp = env_array();
+	path_save();
+	if(FUZZING)
+	{
+		line_arena = saved;
+		return;
+	}
+
+	if((1 == JOBS) && (NULL == STORE_DIR))
+	{ /* Everything before it has been shown, so there is no need to keep its output */
+		if(FALSE == t->shown) task_show(t);
+		fflush(stdout);
+		t->pid = spawn(program, t->argv, envp);
+		line_arena = saved;
+		if(-1 == t->pid) t->status = EXIT_FAILURE << 8;
+		else
+		{
+			processes_spawned = processes_spawned + 1;
+			t->status = job_wait_for(t->pid);
+		}
+		if(0 == t->status) task_finished(t);
+		return;
+	}
+
+	tasks_started = tasks_started + 1;
+	t->out = task_output_name(".out");
+	/* Where stdout and stderr are the one file, one file keeps them in order */
+	if(fd_same_file(1, 2)) t->err = NULL;
+	else t->err = task_output_name(".err");
+	if((NULL != STORE_DIR) && (0 != t->output_count) && store_restore(t, program))
+	{ /* Just as good as running it */
+		t->skipped = TRUE;
+		t->restored = TRUE;
+		t->reason = prepend_string("restored from --store (", prepend_string(t->reason, ")"));
+		line_arena = saved;
+		if(0 == t->status) task_finished(t);
+		return;
+	}
+	t->pid = spawn_captured(program, t->argv, envp, t->out, t->err);
+	line_arena = saved;
+	if(-1 == t->pid)
+	{ /* As if it had exited with EXIT_FAILURE */
+		t->status = EXIT_FAILURE << 8;
+		return;
+	}
+	processes_spawned = processes_spawned + 1;
+	t->state = TASK_RUNNING;
+	tasks_running = tasks_running + 1;
+}
+
+/* Wait for one of the running tasks to finish */
+void task_wait()
+{
+	int status = 0;
+	int pid;
+	struct Task* t;
+	while(TRUE)
+	{
+		pid = job_reap(&status);
+		for(t = window; NULL != t; t = t->next)
+		{
+			if((TASK_RUNNING == t->state) && ((pid == t->pid) || (-1 == pid)))
+			{ /* With -1 nothing is left to wait for, so nothing will ever say */
+				t->state = TASK_DONE;
+				t->status = status;
+				tasks_running = tasks_running - 1;
+				jobserver_release(tasks_running);
+				if(0 == status) task_finished(t);
+				return;
+			}
+		}
+		/* Otherwise it was a background job; job_reap() has it */
+	}
+}
+
+/* Give up on the rest, leaving no files about */
+void schedule_abandon()
+{
+	struct Task* t;
+	for(t = window; NULL != t; t = t->next)
+	{
+		if(TASK_RUNNING == t->state) job_wait_for(t->pid);
+		if(NULL != t->out)
+		{
+			replay_file(t->out, NULL);
+			if(NULL != t->err) replay_file(t->err, NULL);
+		}
+	}
+}
+
+/* Show what a finished task output, as if it had only just been run */
+void task_replay(struct Task* t)
+{
+	if(FALSE == t->shown) task_show(t);
+	if(t->restored)
+	{
+		replay_file(t->out, stdout);
+		if(NULL != t->err) replay_file(t->err, stderr);
+		commands_restored = commands_restored + 1;
+		return;
+	}
+	if(t->skipped)
+	{
+		commands_skipped = commands_skipped + 1;
+		return;
+	}
+	if(t->missing && STRICT)
+	{
+		file_print("WHILE EXECUTING ", stderr);
+		file_print(t->argv[0], stderr);
+		file_print(" NOT FOUND!\nABORTING HARD\n", stderr);
+		schedule_abandon();
+		exit(EXIT_FAILURE);
+	}
+	if(NULL != t->out)
+	{
+		replay_file(t->out, stdout);
+		if(NULL != t->err) replay_file(t->err, stderr);
+		t->out = NULL;
+	}
+	if(-1 == t->pid)
+	{
+		file_print("WHILE EXECUTING ", stderr);
+		file_print(t->argv[0], stderr);
+		file_print(" execve() FAILED\n", stderr);
+	}
+	commands_run = commands_run + 1;
+	if(STRICT && (0 != t->status))
+	{
+		file_print("Subprocess error ", stderr);
+		file_print(numerate_number(t->status), stderr);
+		file_print("\nABORTING HARD\n", stderr);
+		schedule_abandon();
+		exit(EXIT_FAILURE);
+	}
+}
+
+/* Run a compiled program, as many commands at once as JOBS and the declarations allow */
+void run_parallel(struct Program* p)
+{
+	struct Task* t;
+	schedule_position = 0;
+	while(TRUE)
+	{
+		window_fill(p);
+		if(NULL == window) return;
+
+		if(TASK_DONE == window->state)
+		{ /* Its turn to be shown */
+			task_replay(window);
+			window_pop();
+			continue;
+		}
+		if(window->barrier)
+		{ /* Everything before it is done, so just run it */
+			command_index = window->index;
+			run_command(window->command);
+			window_pop();
+			continue;
+		}
+
+		/* Start anything that is free to go */
+		if(1 == JOBS)
+		{ /* In order, and straight out unless --store wants it */
+			if(TASK_WAITING == window->state) task_start(window);
+			if(TASK_RUNNING == window->state) task_wait();
+			continue;
+		}
+		for(t = window; (NULL != t) && (tasks_running < JOBS); t = t->next)
+		{
+			if((TASK_WAITING == t->state) && (FALSE == t->barrier) && task_ready(t))
+			{
+				if(FALSE == jobserver_acquire(tasks_running)) break;
+				task_start(t);
+				jobserver_release(tasks_running);
+			}
+		}
+		if(TASK_DONE == window->state) continue;
+		task_wait();
+	}
+}
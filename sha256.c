@@ -0,0 +1,233 @@
+/* Copyright (C) 2020 fosslinux
+ * This file is part of mescc-tools.
+ *
+ * mescc-tools is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mescc-tools is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mescc-tools.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * SHA-256, as in FIPS 180-4.
+ * Written to build with M2-Planet as well, so everything is kept to 32
+ * bits by masking (unsigned is 64 bits wide there) and the round
+ * constants are filled in at runtime rather than from an initializer.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include "kaem.h"
+
+#define MASK32 0xFFFFFFFF
+//CONSTANT MASK32 0xFFFFFFFF
+
+/* The round constants; filled in by sha256_constants() */
+unsigned* SHA256_K;
+
+void sha256_constants()
+{
+	unsigned* k = calloc(64, sizeof(unsigned));
+	require(k != NULL, "Memory initialization of SHA256_K failed\n");
+	k[0] = 0x428a2f98; k[1] = 0x71374491; k[2] = 0xb5c0fbcf; k[3] = 0xe9b5dba5;
+	k[4] = 0x3956c25b; k[5] = 0x59f111f1; k[6] = 0x923f82a4; k[7] = 0xab1c5ed5;
+	k[8] = 0xd807aa98; k[9] = 0x12835b01; k[10] = 0x243185be; k[11] = 0x550c7dc3;
+	k[12] = 0x72be5d74; k[13] = 0x80deb1fe; k[14] = 0x9bdc06a7; k[15] = 0xc19bf174;
+	k[16] = 0xe49b69c1; k[17] = 0xefbe4786; k[18] = 0x0fc19dc6; k[19] = 0x240ca1cc;
+	k[20] = 0x2de92c6f; k[21] = 0x4a7484aa; k[22] = 0x5cb0a9dc; k[23] = 0x76f988da;
+	k[24] = 0x983e5152; k[25] = 0xa831c66d; k[26] = 0xb00327c8; k[27] = 0xbf597fc7;
+	k[28] = 0xc6e00bf3; k[29] = 0xd5a79147; k[30] = 0x06ca6351; k[31] = 0x14292967;
+	k[32] = 0x27b70a85; k[33] = 0x2e1b2138; k[34] = 0x4d2c6dfc; k[35] = 0x53380d13;
+	k[36] = 0x650a7354; k[37] = 0x766a0abb; k[38] = 0x81c2c92e; k[39] = 0x92722c85;
+	k[40] = 0xa2bfe8a1; k[41] = 0xa81a664b; k[42] = 0xc24b8b70; k[43] = 0xc76c51a3;
+	k[44] = 0xd192e819; k[45] = 0xd6990624; k[46] = 0xf40e3585; k[47] = 0x106aa070;
+	k[48] = 0x19a4c116; k[49] = 0x1e376c08; k[50] = 0x2748774c; k[51] = 0x34b0bcb5;
+	k[52] = 0x391c0cb3; k[53] = 0x4ed8aa4a; k[54] = 0x5b9cca4f; k[55] = 0x682e6ff3;
+	k[56] = 0x748f82ee; k[57] = 0x78a5636f; k[58] = 0x84c87814; k[59] = 0x8cc70208;
+	k[60] = 0x90befffa; k[61] = 0xa4506ceb; k[62] = 0xbef9a3f7; k[63] = 0xc67178f2;
+	SHA256_K = k;
+}
+
+unsigned sha256_rotr(unsigned x, int n)
+{
+	return ((x >> n) | (x << (32 - n))) & MASK32;
+}
+
+/* Start a new hash */
+struct SHA256* sha256_init()
+{
+	if(NULL == SHA256_K) sha256_constants();
+	struct SHA256* c = calloc(1, sizeof(struct SHA256));
+	require(c != NULL, "Memory initialization of sha256 context failed\n");
+	c->h = calloc(8, sizeof(unsigned));
+	c->w = calloc(64, sizeof(unsigned));
+	c->block = calloc(64, sizeof(char));
+	require((c->h != NULL) && (c->w != NULL) && (c->block != NULL), "Memory initialization of sha256 context failed\n");
+	c->h[0] = 0x6a09e667;
+	c->h[1] = 0xbb67ae85;
+	c->h[2] = 0x3c6ef372;
+	c->h[3] = 0xa54ff53a;
+	c->h[4] = 0x510e527f;
+	c->h[5] = 0x9b05688c;
+	c->h[6] = 0x1f83d9ab;
+	c->h[7] = 0x5be0cd19;
+	return c;
+}
+
+/* Run the compression function over one 64 byte block */
+void sha256_block(struct SHA256* c, char* block)
+{
+	unsigned* w = c->w;
+	unsigned* h = c->h;
+	int i;
+	unsigned s0;
+	unsigned s1;
+	unsigned t1;
+	unsigned t2;
+	for(i = 0; i < 16; i = i + 1)
+	{
+		w[i] = ((block[4 * i] & 0xFF) << 24) | ((block[(4 * i) + 1] & 0xFF) << 16) | ((block[(4 * i) + 2] & 0xFF) << 8) | (block[(4 * i) + 3] & 0xFF);
+	}
+	for(i = 16; i < 64; i = i + 1)
+	{
+		s0 = sha256_rotr(w[i - 15], 7) ^ sha256_rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+		s1 = sha256_rotr(w[i - 2], 17) ^ sha256_rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+		w[i] = (w[i - 16] + s0 + w[i - 7] + s1) & MASK32;
+	}
+
+	unsigned a = h[0];
+	unsigned b = h[1];
+	unsigned cc = h[2];
+	unsigned d = h[3];
+	unsigned e = h[4];
+	unsigned f = h[5];
+	unsigned g = h[6];
+	unsigned hh = h[7];
+	for(i = 0; i < 64; i = i + 1)
+	{
+		s1 = sha256_rotr(e, 6) ^ sha256_rotr(e, 11) ^ sha256_rotr(e, 25);
+		t1 = (hh + s1 + ((e & f) ^ ((~e) & g)) + SHA256_K[i] + w[i]) & MASK32;
+		s0 = sha256_rotr(a, 2) ^ sha256_rotr(a, 13) ^ sha256_rotr(a, 22);
+		t2 = (s0 + ((a & b) ^ (a & cc) ^ (b & cc))) & MASK32;
+		hh = g;
+		g = f;
+		f = e;
+		e = (d + t1) & MASK32;
+		d = cc;
+		cc = b;
+		b = a;
+		a = (t1 + t2) & MASK32;
+	}
+	h[0] = (h[0] + a) & MASK32;
+	h[1] = (h[1] + b) & MASK32;
+	h[2] = (h[2] + cc) & MASK32;
+	h[3] = (h[3] + d) & MASK32;
+	h[4] = (h[4] + e) & MASK32;
+	h[5] = (h[5] + f) & MASK32;
+	h[6] = (h[6] + g) & MASK32;
+	h[7] = (h[7] + hh) & MASK32;
+}
+
+/* Add length bytes of data to the hash */
+void sha256_update(struct SHA256* c, char* data, int length)
+{
+	int i = 0;
+	unsigned added = length;
+	/* Keep a 64 bit count of the bytes, in two halves */
+	c->length_low = (c->length_low + added) & MASK32;
+	if(c->length_low < added) c->length_high = c->length_high + 1;
+
+	/* Finish off any partial block first */
+	while((0 != c->used) && (i < length))
+	{
+		c->block[c->used] = data[i];
+		c->used = c->used + 1;
+		i = i + 1;
+		if(64 == c->used)
+		{
+			sha256_block(c, c->block);
+			c->used = 0;
+		}
+	}
+	/* Then whole blocks straight from data, all at once if the CPU can (see platform.c) */
+	if(i + 64 <= length) i = i + (64 * sha256_blocks(c->h, data + i, (length - i) / 64));
+	while(i + 64 <= length)
+	{
+		sha256_block(c, data + i);
+		i = i + 64;
+	}
+	/* Keep whatever is left for next time */
+	while(i < length)
+	{
+		c->block[c->used] = data[i];
+		c->used = c->used + 1;
+		i = i + 1;
+	}
+}
+
+/* Add a string, without its terminating NUL */
+void sha256_string(struct SHA256* c, char* s)
+{
+	sha256_update(c, s, string_length(s));
+}
+
+/* Finish the hash and return it as 64 lowercase hex digits */
+char* sha256_hex(struct SHA256* c)
+{
+	unsigned high = ((c->length_high << 3) | (c->length_low >> 29)) & MASK32;
+	unsigned low = (c->length_low << 3) & MASK32;
+	char* hex = "0123456789abcdef";
+	int i;
+
+	/* Pad with a 1 bit, then 0s to 56 bytes, then the length in bits */
+	c->block[c->used] = 0x80;
+	c->used = c->used + 1;
+	if(c->used > 56)
+	{
+		while(c->used < 64)
+		{
+			c->block[c->used] = 0;
+			c->used = c->used + 1;
+		}
+		sha256_block(c, c->block);
+		c->used = 0;
+	}
+	while(c->used < 56)
+	{
+		c->block[c->used] = 0;
+		c->used = c->used + 1;
+	}
+	for(i = 0; i < 4; i = i + 1)
+	{
+		c->block[56 + i] = (high >> (24 - (8 * i))) & 0xFF;
+		c->block[60 + i] = (low >> (24 - (8 * i))) & 0xFF;
+	}
+	sha256_block(c, c->block);
+
+	char* result = calloc(65, sizeof(char));
+	require(result != NULL, "Memory initialization of sha256 result failed\n");
+	int byte;
+	for(i = 0; i < 32; i = i + 1)
+	{
+		byte = (c->h[i / 4] >> (24 - (8 * (i % 4)))) & 0xFF;
+		result[2 * i] = hex[byte >> 4];
+		result[(2 * i) + 1] = hex[byte & 0xF];
+	}
+	return result;
+}
+
+/* Let go of c, once its hash has been taken */
+void sha256_free(struct SHA256* c)
+{
+	free(c->h);
+	free(c->w);
+	free(c->block);
+	free(c);
+}
@@ -0,0 +1,437 @@
+/* Copyright (C) 2020 fosslinux
+ * This file is part of mescc-tools.
+ *
+ * mescc-tools is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mescc-tools is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mescc-tools.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * INCREMENTAL RUNS
+ * With --state, kaem remembers how each declared command (see schedule.c)
+ * was last run: the SHA-256 of its expanded argv and of PATH and whatever
+ * variables it named with @env (see state_env()), and the names, stamps
+ * (see file_stamp()) and SHA-256 of what it read and wrote. Next time, a
+ * command is skipped when all of that still holds; it is known by the
+ * first file it writes, so a command that declares no @out always runs.
+ * A file whose stamp has not changed is not read again, its hash is taken
+ * as it was. With --explain each command says why it ran,
+ * or why not.
+ *
+ * The file is only ever appended to, one record per command run, so that
+ * a run that is cut short still keeps what it did. A later record for the
+ * same first output replaces an earlier one. It looks like:
+ *   kaemSTATE01
+ *   C argv-hash env-hash number-of-inputs number-of-outputs
+ *   I stamp hash name    (for each input)
+ *   O stamp hash name    (for each output)
+ * Missing stamps and hashes are written as -. Anything that does not
+ * parse ends the file there, as if the rest had not been written, and the
+ * file is written out again before anything is added to it; as it is at
+ * exit when it is mostly replaced records.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include "kaem.h"
+
+#define STATE_BUCKETS 4096
+//CONSTANT STATE_BUCKETS 4096
+
+/* Records by the first output, chained */
+struct Record** state_buckets;
+/* All of them, in the order they were read or made */
+struct Record* state_first;
+struct Record* state_last;
+/* Records in the file, and how many are still wanted */
+int state_written;
+int state_live;
+/* Where new records are appended; NULL until there is one */
+FILE* state_out;
+/* The file is missing, or not all of it could be read; it is started again */
+int state_fresh;
+
+/* The next field of the line, up to one of the space or newline */
+char* state_field(struct Script* s, int last)
+{
+	int start = s->position;
+	while((s->position < s->length) && ('\n' != s->buffer[s->position]))
+	{
+		if((FALSE == last) && (' ' == s->buffer[s->position])) break;
+		s->position = s->position + 1;
+	}
+	if(s->position >= s->length) return NULL;
+	if(last != ('\n' == s->buffer[s->position])) return NULL;
+	char* r = arena_calloc(long_arena, s->position - start + 1, sizeof(char));
+	int i;
+	for(i = start; i < s->position; i = i + 1) r[i - start] = s->buffer[i];
+	s->position = s->position + 1;
+	return r;
+}
+
+/* A stamp or hash as it was written, so - is none */
+char* state_maybe(char* field)
+{
+	if(match(field, "-")) return NULL;
+	return field;
+}
+
+struct Record* state_find(char* key)
+{
+	struct Record* r = state_buckets[env_hash(key, string_length(key)) & (STATE_BUCKETS - 1)];
+	while(NULL != r)
+	{
+		if(match(key, r->key)) return r;
+		r = r->chain;
+	}
+	return NULL;
+}
+
+/* Put r in the table, in place of whatever had its first output */
+void state_add(struct Record* r)
+{
+	int bucket = env_hash(r->key, string_length(r->key)) & (STATE_BUCKETS - 1);
+	struct Record* old = state_find(r->key);
+	if(NULL != old)
+	{
+		old->replaced = TRUE;
+		state_live = state_live - 1;
+	}
+	r->chain = state_buckets[bucket];
+	state_buckets[bucket] = r;
+	if(NULL == state_first) state_first = r;
+	else state_last->next = r;
+	state_last = r;
+	state_live = state_live + 1;
+}
+
+/* Read the files of one I or O line each into names, stamps and hashes */
+int state_read_files(struct Script* s, char* kind, char** names, char** stamps, char** hashes, int count)
+{
+	int i;
+	char* field;
+	char* stamp;
+	char* hash;
+	for(i = 0; i < count; i = i + 1)
+	{
+		field = state_field(s, FALSE);
+		if((NULL == field) || (FALSE == match(field, kind))) return FALSE;
+		stamp = state_field(s, FALSE);
+		hash = state_field(s, FALSE);
+		names[i] = state_field(s, TRUE);
+		if((NULL == stamp) || (NULL == hash) || (NULL == names[i])) return FALSE;
+		stamps[i] = state_maybe(stamp);
+		hashes[i] = state_maybe(hash);
+	}
+	return TRUE;
+}
+
+/* One record, or NULL at the end of what can be read */
+struct Record* state_read(struct Script* s)
+{
+	char* field = state_field(s, FALSE);
+	if((NULL == field) || (FALSE == match(field, "C"))) return NULL;
+	struct Record* r = arena_calloc(long_arena, 1, sizeof(struct Record));
+	r->argv_hash = state_field(s, FALSE);
+	r->env_hash = state_field(s, FALSE);
+	field = state_field(s, FALSE);
+	if((NULL == r->argv_hash) || (NULL == r->env_hash) || (NULL == field)) return NULL;
+	r->input_count = numerate_string(field);
+	field = state_field(s, TRUE);
+	if(NULL == field) return NULL;
+	r->output_count = numerate_string(field);
+	/* Every file takes a line, so there can't be more than the bytes left */
+	if((0 > r->input_count) || (1 > r->output_count)) return NULL;
+	if((r->input_count + r->output_count) > (s->length - s->position)) return NULL;
+
+	r->inputs = arena_calloc(long_arena, r->input_count + 1, sizeof(char*));
+	r->input_stamps = arena_calloc(long_arena, r->input_count + 1, sizeof(char*));
+	r->input_hashes = arena_calloc(long_arena, r->input_count + 1, sizeof(char*));
+	r->outputs = arena_calloc(long_arena, r->output_count, sizeof(char*));
+	r->output_stamps = arena_calloc(long_arena, r->output_count, sizeof(char*));
+	r->output_hashes = arena_calloc(long_arena, r->output_count, sizeof(char*));
+	if(!state_read_files(s, "I", r->inputs, r->input_stamps, r->input_hashes, r->input_count)) return NULL;
+	if(!state_read_files(s, "O", r->outputs, r->output_stamps, r->output_hashes, r->output_count)) return NULL;
+	r->key = r->outputs[0];
+	return r;
+}
+
+/* Read in what STATE_FILE has from before */
+void state_load()
+{
+	struct Script* s = arena_calloc(long_arena, 1, sizeof(struct Script));
+	struct Record* r;
+	char* magic = "kaemSTATE01\n";
+	int i;
+	state_buckets = arena_calloc(long_arena, STATE_BUCKETS, sizeof(struct Record*));
+	state_fresh = TRUE;
+	if(FALSE == map_file(s, STATE_FILE)) return;
+	if(s->length < 12) return;
+	for(i = 0; i < 12; i = i + 1)
+	{
+		if(magic[i] != s->buffer[i]) return;
+	}
+	state_fresh = FALSE;
+
+	s->position = 12;
+	int good = s->position;
+	r = state_read(s);
+	while(NULL != r)
+	{
+		state_add(r);
+		state_written = state_written + 1;
+		good = s->position;
+		r = state_read(s);
+	}
+	/* Anything appended after something that does not parse would be lost */
+	state_fresh = good < s->length;
+}
+
+/* The SHA-256 of a file's contents; NULL if it can't be read */
+char* state_file_hash(char* name)
+{
+	char* hex = calloc(65, sizeof(char));
+	require(hex != NULL, "Memory initialization of file hash failed\n");
+	if(0 == fs_hash(name, hex)) return hex;
+	free(hex);
+	return NULL;
+}
+
+/* Each string, with its NUL, so that a b and "a b" differ */
+char* state_strings_hash(char** strings, int count)
+{
+	struct SHA256* h = sha256_init();
+	int i;
+	for(i = 0; i < count; i = i + 1)
+	{
+		sha256_update(h, strings[i], string_length(strings[i]) + 1);
+	}
+	char* hex = sha256_hex(h);
+	sha256_free(h);
+	return hex;
+}
+
+/* A variable and its value, or that it is not set */
+void state_env_add(struct SHA256* h, char* name)
+{
+	char* value = env_lookup(name);
+	sha256_update(h, name, string_length(name) + 1);
+	if(NULL == value)
+	{
+		sha256_string(h, "unset\n");
+		return;
+	}
+	sha256_string(h, "=");
+	sha256_update(h, value, string_length(value) + 1);
+}
+
+/*
+ * The hash of the env as far as t goes: PATH, and the variables it named
+ * with @env. Nothing else is taken in, as the likes of HOSTNAME, PWD,
+ * MAKEFLAGS and kaem's own differ from one machine or run to the next
+ * without changing what the command does.
+ */
+char* state_env(struct Task* t)
+{
+	struct SHA256* h = sha256_init();
+	int i;
+	state_env_add(h, "PATH");
+	for(i = 0; i < t->env_count; i = i + 1) state_env_add(h, t->env_names[i]);
+	char* hex = sha256_hex(h);
+	sha256_free(h);
+	return hex;
+}
+
+/* The hash of a file, trusting the one from before if its stamp still matches */
+char* state_hash(char* name, char* stamp, char* old_name, char* old_stamp, char* old_hash)
+{
+	if((NULL != stamp) && (NULL != old_stamp) && match(name, old_name) && match(stamp, old_stamp))
+	{
+		return old_hash;
+	}
+	return state_file_hash(name);
+}
+
+/* Why it runs: reason, then name if there is one */
+int state_stale(struct Task* t, char* reason, char* name)
+{
+	if(NULL == name) t->reason = reason;
+	else t->reason = prepend_string(name, reason);
+	return FALSE;
+}
+
+/*
+ * Whether t can be skipped, with t->reason saying why or why not. Its
+ * inputs are hashed either way, ready for state_record() once it has run.
+ */
+int state_current(struct Task* t)
+{
+	struct Record* r = NULL;
+	char* old_name;
+	char* old_stamp;
+	char* old_hash;
+	char* hash;
+	int i;
+	t->argv_hash = state_strings_hash(t->argv, t->argc);
+	t->input_stamps = arena_calloc(t->arena, t->input_count + 1, sizeof(char*));
+	t->input_hashes = arena_calloc(t->arena, t->input_count + 1, sizeof(char*));
+	if((NULL != STATE_FILE) && (0 != t->output_count)) r = state_find(t->outputs[0]);
+	for(i = 0; i < t->input_count; i = i + 1)
+	{
+		old_name = NULL;
+		old_stamp = NULL;
+		old_hash = NULL;
+		if((NULL != r) && (i < r->input_count))
+		{
+			old_name = r->inputs[i];
+			old_stamp = r->input_stamps[i];
+			old_hash = r->input_hashes[i];
+		}
+		t->input_stamps[i] = file_stamp(t->inputs[i]);
+		t->input_hashes[i] = state_hash(t->inputs[i], t->input_stamps[i], old_name, old_stamp, old_hash);
+	}
+
+	if(NULL == STATE_FILE) return state_stale(t, "there is no --state", NULL);
+	if(0 == t->output_count) return state_stale(t, "it declares no @out", NULL);
+	if(NULL == r) return state_stale(t, " has no record", t->outputs[0]);
+	if(FALSE == match(t->argv_hash, r->argv_hash)) return state_stale(t, "its command line changed", NULL);
+	if(FALSE == match(state_env(t), r->env_hash)) return state_stale(t, "the env changed", NULL);
+	if(t->input_count != r->input_count) return state_stale(t, "its @in changed", NULL);
+	for(i = 0; i < t->input_count; i = i + 1)
+	{
+		if(FALSE == match(t->inputs[i], r->inputs[i])) return state_stale(t, "its @in changed", NULL);
+		if(NULL == t->input_hashes[i]) return state_stale(t, " is missing", t->inputs[i]);
+		if(FALSE == match(t->input_hashes[i], r->input_hashes[i])) return state_stale(t, " changed", t->inputs[i]);
+	}
+	if(t->output_count != r->output_count) return state_stale(t, "its @out changed", NULL);
+	for(i = 0; i < t->output_count; i = i + 1)
+	{
+		if(FALSE == match(t->outputs[i], r->outputs[i])) return state_stale(t, "its @out changed", NULL);
+		hash = state_hash(t->outputs[i], file_stamp(t->outputs[i]), r->outputs[i], r->output_stamps[i], r->output_hashes[i]);
+		if(NULL == hash) return state_stale(t, " is missing", t->outputs[i]);
+		if(FALSE == match(hash, r->output_hashes[i])) return state_stale(t, " changed", t->outputs[i]);
+	}
+	t->reason = "up to date";
+	return TRUE;
+}
+
+/* A stamp or hash, or - for none */
+void state_put(FILE* f, char* s, char* after)
+{
+	if(NULL == s) s = "-";
+	file_print(s, f);
+	file_print(after, f);
+}
+
+void state_put_files(FILE* f, char* kind, char** names, char** stamps, char** hashes, int count)
+{
+	int i;
+	for(i = 0; i < count; i = i + 1)
+	{
+		file_print(kind, f);
+		state_put(f, stamps[i], " ");
+		state_put(f, hashes[i], " ");
+		state_put(f, names[i], "\n");
+	}
+}
+
+void state_write(FILE* f, struct Record* r)
+{
+	file_print("C ", f);
+	state_put(f, r->argv_hash, " ");
+	state_put(f, r->env_hash, " ");
+	file_print(numerate_number(r->input_count), f);
+	file_print(" ", f);
+	file_print(numerate_number(r->output_count), f);
+	file_print("\n", f);
+	state_put_files(f, "I ", r->inputs, r->input_stamps, r->input_hashes, r->input_count);
+	state_put_files(f, "O ", r->outputs, r->output_stamps, r->output_hashes, r->output_count);
+}
+
+/* Copy the names and such of a task into long-lived memory */
+char** state_keep(char** strings, int count)
+{
+	char** r = arena_calloc(long_arena, count + 1, sizeof(char*));
+	int i;
+	for(i = 0; i < count; i = i + 1)
+	{
+		if(NULL != strings[i]) r[i] = arena_string(long_arena, strings[i]);
+	}
+	return r;
+}
+
+/* Write out the records that have not been replaced, in place of the file */
+void state_rewrite()
+{
+	struct Record* r;
+	char* temp = temp_name(STATE_FILE);
+	FILE* f = fopen(temp, "w");
+	if(NULL == f) return;
+	file_print("kaemSTATE01\n", f);
+	for(r = state_first; NULL != r; r = r->next)
+	{
+		if(FALSE == r->replaced) state_write(f, r);
+	}
+	fclose(f);
+	replace_file(temp, STATE_FILE);
+	state_written = state_live;
+}
+
+/* Remember how t was run, now that it has run successfully */
+void state_record(struct Task* t)
+{
+	if((NULL == STATE_FILE) || (0 == t->output_count)) return;
+	struct Record* r = arena_calloc(long_arena, 1, sizeof(struct Record));
+	int i;
+	r->argv_hash = t->argv_hash;
+	r->env_hash = state_env(t);
+	r->input_count = t->input_count;
+	r->inputs = state_keep(t->inputs, t->input_count);
+	r->input_stamps = state_keep(t->input_stamps, t->input_count);
+	r->input_hashes = state_keep(t->input_hashes, t->input_count);
+	r->output_count = t->output_count;
+	r->outputs = state_keep(t->outputs, t->output_count);
+	r->output_stamps = arena_calloc(long_arena, r->output_count, sizeof(char*));
+	r->output_hashes = arena_calloc(long_arena, r->output_count, sizeof(char*));
+	for(i = 0; i < r->output_count; i = i + 1)
+	{
+		r->output_stamps[i] = file_stamp(r->outputs[i]);
+		r->output_hashes[i] = state_file_hash(r->outputs[i]);
+	}
+	r->key = r->outputs[0];
+
+	if(NULL == state_out)
+	{
+		/* Start it again, with what could be read of it */
+		if(state_fresh) state_rewrite();
+		state_fresh = FALSE;
+		state_out = fopen(STATE_FILE, "a");
+		if(NULL == state_out)
+		{ /* Nothing to be done; it just won't be remembered */
+			STATE_FILE = NULL;
+			return;
+		}
+	}
+	state_add(r);
+	state_write(state_out, r);
+	fflush(state_out);
+	state_written = state_written + 1;
+}
+
+/* Done with the file; write it out again if it is mostly replaced records */
+void state_save()
+{
+	if(NULL == STATE_FILE) return;
+	if(NULL != state_out) fclose(state_out);
+	state_out = NULL;
+	if(state_written > (2 * state_live) + 64) state_rewrite();
+}
@@ -0,0 +1,200 @@
+/* Copyright (C) 2020 fosslinux
+ * This file is part of mescc-tools.
+ *
+ * mescc-tools is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mescc-tools is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mescc-tools.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * RESULT STORE
+ * With --store, what a declared command produced is kept in a directory,
+ * under the SHA-256 of everything that went into it: its expanded argv,
+ * PATH and whatever variables it named with @env, the program itself, the name and contents of each @in, and
+ * the names of its @out files. When the same hash comes up again, on this
+ * machine or on any other sharing the directory, its @out files and what
+ * it printed are copied back instead of running it. Copies are reflinks
+ * where the filesystem can manage it. Only commands that succeed are kept.
+ *
+ * It is all plain files, so it can be shared over NFS or with rsync:
+ *   XX/HASH.out.N   each @out, in the order they were declared
+ *   XX/HASH.stdout  what it printed
+ *   XX/HASH.stderr
+ *   XX/HASH         kaemSTORE01, its exit status and the number of @out,
+ *                   a line each
+ * where XX is the first two digits of HASH. Each file is written under a
+ * temporary name and then moved into place, HASH last of all, so a result
+ * is either all there or not there at all.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include "kaem.h"
+
+/* Programs hashed so far; they are only read again if their stamp changes */
+struct Hashed* store_programs;
+
+char* store_program_hash(char* program)
+{
+	char* stamp = file_stamp(program);
+	struct Hashed* h;
+	for(h = store_programs; NULL != h; h = h->next)
+	{
+		if(match(program, h->name)) break;
+	}
+	if(NULL == h)
+	{
+		h = calloc(1, sizeof(struct Hashed));
+		require(h != NULL, "Memory initialization of program hash failed\n");
+		h->name = arena_string(long_arena, program);
+		h->next = store_programs;
+		store_programs = h;
+	}
+	else if((NULL != stamp) && (NULL != h->stamp) && match(stamp, h->stamp)) return h->hash;
+	h->stamp = stamp;
+	h->hash = state_file_hash(program);
+	return h->hash;
+}
+
+/* The hash t's result is kept under; NULL if it can't be kept */
+char* store_key(struct Task* t, char* program)
+{
+	struct SHA256* c = sha256_init();
+	char* hash = store_program_hash(program);
+	int i;
+	if(NULL == hash) return NULL;
+	sha256_string(c, "kaemSTORE01\n");
+	sha256_string(c, t->argv_hash);
+	sha256_string(c, state_env(t));
+	sha256_string(c, hash);
+	if(NULL == t->err) sha256_string(c, "\nstdout and stderr together");
+	for(i = 0; i < t->input_count; i = i + 1)
+	{
+		if(NULL == t->input_hashes[i]) return NULL;
+		sha256_string(c, "\nin ");
+		sha256_update(c, t->inputs[i], string_length(t->inputs[i]) + 1);
+		sha256_string(c, t->input_hashes[i]);
+	}
+	for(i = 0; i < t->output_count; i = i + 1)
+	{
+		sha256_string(c, "\nout ");
+		sha256_update(c, t->outputs[i], string_length(t->outputs[i]) + 1);
+	}
+	return arena_string(t->arena, sha256_hex(c));
+}
+
+/* The directory a key's files go in */
+char* store_shard(char* key)
+{
+	char* shard = arena_calloc(line_arena, 3, sizeof(char));
+	shard[0] = key[0];
+	shard[1] = key[1];
+	return prepend_string(STORE_DIR, prepend_string("/", shard));
+}
+
+char* store_name(char* key, char* suffix)
+{
+	return prepend_string(store_shard(key), prepend_string("/", prepend_string(key, suffix)));
+}
+
+char* store_output_name(char* key, int i)
+{
+	return store_name(key, prepend_string(".out.", numerate_number(i)));
+}
+
+/* Copy from to to by way of a temporary name, so to is never half there */
+int store_copy(char* from, char* to)
+{
+	char* temp = temp_name(to);
+	if(FALSE == copy_file(from, temp)) return FALSE;
+	return replace_file(temp, to);
+}
+
+/* The next line of s as a number; -1 if there isn't one */
+int store_number(struct Script* s)
+{
+	int start = s->position;
+	while((s->position < s->length) && ('\n' != s->buffer[s->position])) s->position = s->position + 1;
+	if(s->position >= s->length) return -1;
+	char* line = arena_calloc(line_arena, s->position - start + 1, sizeof(char));
+	int i;
+	for(i = start; i < s->position; i = i + 1) line[i - start] = s->buffer[i];
+	s->position = s->position + 1;
+	if(match(line, "0")) return 0;
+	i = numerate_string(line);
+	if(0 == i) return -1;
+	return i;
+}
+
+/*
+ * Put back what t produced last time, if the store has it. Its stdout
+ * and stderr go to t->out and t->err (or both to t->out, when it has no
+ * t->err), to be shown when it is its turn.
+ */
+int store_restore(struct Task* t, char* program)
+{
+	struct Script* s = arena_calloc(line_arena, 1, sizeof(struct Script));
+	char* magic = "kaemSTORE01\n";
+	int i;
+	t->store_key = store_key(t, program);
+	if(NULL == t->store_key) return FALSE;
+	if(FALSE == map_file(s, store_name(t->store_key, ""))) return FALSE;
+	if(s->length < 12) return FALSE;
+	for(i = 0; i < 12; i = i + 1)
+	{
+		if(magic[i] != s->buffer[i]) return FALSE;
+	}
+	s->position = 12;
+	t->status = store_number(s);
+	if((0 > t->status) || (t->output_count != store_number(s))) return FALSE;
+
+	for(i = 0; i < t->output_count; i = i + 1)
+	{
+		if(FALSE == store_copy(store_output_name(t->store_key, i), t->outputs[i])) return FALSE;
+	}
+	if(FALSE == copy_file(store_name(t->store_key, ".stdout"), t->out)) return FALSE;
+	if(NULL == t->err) return TRUE;
+	return copy_file(store_name(t->store_key, ".stderr"), t->err);
+}
+
+/* Keep what t produced, now that it has run successfully */
+void store_save(struct Task* t)
+{
+	struct Arena* saved = line_arena;
+	struct Buffer* b;
+	char* name;
+	char* temp;
+	int i;
+	if(NULL == t->store_key) return;
+	line_arena = t->arena;
+	if(FALSE == make_directory(STORE_DIR)) goto done;
+	if(FALSE == make_directory(store_shard(t->store_key))) goto done;
+	for(i = 0; i < t->output_count; i = i + 1)
+	{
+		if(FALSE == store_copy(t->outputs[i], store_output_name(t->store_key, i))) goto done;
+	}
+	if(FALSE == store_copy(t->out, store_name(t->store_key, ".stdout"))) goto done;
+	if((NULL != t->err) && (FALSE == store_copy(t->err, store_name(t->store_key, ".stderr")))) goto done;
+
+	b = buffer_new(line_arena, 32);
+	buffer_add_string(b, "kaemSTORE01\n");
+	buffer_add_string(b, numerate_number(t->status));
+	buffer_add_string(b, "\n");
+	buffer_add_string(b, numerate_number(t->output_count));
+	buffer_add_string(b, "\n");
+	name = store_name(t->store_key, "");
+	temp = temp_name(name);
+	if(write_file(temp, b->text, b->length)) replace_file(temp, name);
+	commands_stored = commands_stored + 1;
+done:
+	line_arena = saved;
+}
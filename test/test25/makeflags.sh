@@ -0,0 +1,30 @@
+#!/bin/sh
+# Copyright (C) 2020 fosslinux
+# This file is part of mescc-tools.
+#
+# mescc-tools is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# mescc-tools is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with mescc-tools.  If not, see <http://www.gnu.org/licenses/>.
+
+# Print MAKEFLAGS without the jobserver's fds, and count its tokens
+case "$MAKEFLAGS" in
+*--jobserver-auth=*)
+	echo "MAKEFLAGS=${MAKEFLAGS%%--jobserver-auth=*}--jobserver-auth=..."
+	auth="${MAKEFLAGS##*--jobserver-auth=}"
+	read_fd="${auth%%,*}"
+	tokens=$(timeout 1 dd bs=1 count=16 iflag=nonblock <&"$read_fd" 2>/dev/null | wc -c)
+	echo "tokens: $tokens"
+	;;
+*)
+	echo "MAKEFLAGS=$MAKEFLAGS"
+	;;
+esac
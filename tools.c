@@ -0,0 +1,786 @@
+/* Copyright (C) 2020 fosslinux
+ * This file is part of mescc-tools.
+ *
+ * mescc-tools is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * mescc-tools is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with mescc-tools.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * TOOLS
+ * Bootstrap scripts are full of mkdir -p, rm -f, chmod, touch, mv and
+ * ln -s, each a fork and exec for a single system call, and of cp and cat
+ * copying files that the kernel can copy for them, and of sha256sum
+ * checking what was built, one file after another. kaem does these
+ * itself when it understands the whole command: the options used here
+ * are the coreutils ones, and the messages and exit status are the same.
+ * Anything else (other options, chmod -R, mv across filesystems, rm -r /,
+ * cp of a directory, names that coreutils would quote in its messages
+ * and the like) and the real program is run instead, as is everything
+ * when --no-builtins is given or the platform can't (see platform_m2.c).
+ *
+ * Unlike the real programs these never ask before removing or replacing
+ * a write-protected file on a terminal; scripts don't answer anyway.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include "kaem.h"
+
+/* The options seen by tool_options(), by letter; and what is left */
+int* tool_flags;
+char** tool_operands;
+int tool_operand_count;
+/* The -m of mkdir */
+char* tool_mode;
+/* Something went wrong, so the tool exits 1 */
+int tool_failed;
+
+/* Which program kaem can do itself a command name refers to, if any */
+int tool_code(char* name)
+{
+	if(match(name, "mkdir")) return BUILTIN_MKDIR;
+	if(match(name, "rm")) return BUILTIN_RM;
+	if(match(name, "chmod")) return BUILTIN_CHMOD;
+	if(match(name, "touch")) return BUILTIN_TOUCH;
+	if(match(name, "mv")) return BUILTIN_MV;
+	if(match(name, "ln")) return BUILTIN_LN;
+	if(match(name, "cp")) return BUILTIN_CP;
+	if(match(name, "cat")) return BUILTIN_CAT;
+	if(match(name, "sha256sum")) return BUILTIN_SHA256SUM;
+	return BUILTIN_NONE;
+}
+
+/*
+ * Sort argv into options and operands, as getopt does: options can come
+ * anywhere before --, and letters can be run together (-rf). Only the
+ * letters in allowed are understood; FALSE for anything else, so that the
+ * real program can deal with it. mkdir's -m takes the rest of its word,
+ * or the next one, as tool_mode.
+ */
+int tool_options(char** argv, int argc, char* allowed)
+{
+	int i;
+	int j;
+	int c;
+	int options = TRUE;
+	tool_flags = arena_calloc(line_arena, 128, sizeof(int));
+	tool_operands = arena_calloc(line_arena, argc + 1, sizeof(char*));
+	tool_operand_count = 0;
+	tool_mode = NULL;
+	tool_failed = FALSE;
+	for(i = 1; i < argc; i = i + 1)
+	{
+		if(options && match(argv[i], "--"))
+		{
+			options = FALSE;
+		}
+		else if(options && ('-' == argv[i][0]) && (0 != argv[i][1]))
+		{
+			for(j = 1; 0 != argv[i][j]; j = j + 1)
+			{
+				c = argv[i][j];
+				if(!in_set(c, allowed)) return FALSE;
+				tool_flags[c] = TRUE;
+				if('m' == c)
+				{ /* The mode is the rest of this word, or the next */
+					if(0 != argv[i][j + 1]) tool_mode = argv[i] + j + 1;
+					else
+					{
+						i = i + 1;
+						if(i >= argc) return FALSE;
+						tool_mode = argv[i];
+					}
+					break;
+				}
+			}
+		}
+		else
+		{
+			tool_operands[tool_operand_count] = argv[i];
+			tool_operand_count = tool_operand_count + 1;
+		}
+	}
+	return TRUE;
+}
+
+/*
+ * Is name one that coreutils prints as it is. Anything else (spaces, :, =
+ * and the like, a leading ~ or #, nothing at all) it quotes, in ways best
+ * left to it.
+ */
+int tool_plain(char* name)
+{
+	int i;
+	if(0 == name[0]) return FALSE;
+	for(i = 0; 0 != name[i]; i = i + 1)
+	{
+		if(('a' <= name[i]) && ('z' >= name[i])) continue;
+		if(('A' <= name[i]) && ('Z' >= name[i])) continue;
+		if(!in_set(name[i], "0123456789%+,-./@_")) return FALSE;
+	}
+	return TRUE;
+}
+
+/* Are the operands from first on all plain names */
+int tool_plain_names(int first)
+{
+	int i;
+	for(i = first; i < tool_operand_count; i = i + 1)
+	{
+		if(!tool_plain(tool_operands[i])) return FALSE;
+	}
+	return TRUE;
+}
+
+/* Report a failure the way coreutils does: "NAME: WHAT 'FILE': ERROR" */
+void tool_error(char* name, char* what, char* file, int error)
+{
+	fflush(stdout);
+	file_print(name, stderr);
+	file_print(": ", stderr);
+	file_print(what, stderr);
+	file_print(" '", stderr);
+	file_print(file, stderr);
+	file_print("': ", stderr);
+	file_print(fs_error(error), stderr);
+	file_print("\n", stderr);
+	tool_failed = TRUE;
+}
+
+/* The last part of a path, ignoring any / on the end */
+char* tool_basename(char* path)
+{
+	int end = string_length(path);
+	int start;
+	int i;
+	char* r;
+	while((1 < end) && ('/' == path[end - 1])) end = end - 1;
+	start = end;
+	while((0 < start) && ('/' != path[start - 1])) start = start - 1;
+	/* Just / stays as it is */
+	if(start == end) start = 0;
+	r = arena_calloc(line_arena, end - start + 1, sizeof(char));
+	for(i = start; i < end; i = i + 1) r[i - start] = path[i];
+	return r;
+}
+
+/* directory/name */
+char* tool_join(char* directory, char* name)
+{
+	int length = string_length(directory);
+	if((0 < length) && ('/' == directory[length - 1])) return arena_string(line_arena, prepend_string(directory, name));
+	return arena_string(line_arena, prepend_string(directory, prepend_string("/", name)));
+}
+
+/*
+ * The mode that mode (octal, or symbolic like u+x,go-w) makes of old; -1
+ * if it is something this doesn't do, like s, t or u=g. A symbolic mode
+ * with no ugoa is masked by the umask, as chmod does.
+ */
+int tool_parse_mode(char* mode, int old, int directory)
+{
+	int i = 0;
+	int who;
+	int op;
+	int bits;
+	int value = 0;
+	int mask = fs_umask();
+
+	if(0 == mode[0]) return -1;
+	if(in_set(mode[0], "01234567"))
+	{
+		while(0 != mode[i])
+		{
+			if(!in_set(mode[i], "01234567") || (4 <= i)) return -1;
+			value = (value << 3) | (mode[i] - '0');
+			i = i + 1;
+		}
+		return value;
+	}
+
+	value = old;
+	while(TRUE)
+	{
+		who = 0;
+		while(in_set(mode[i], "ugoa"))
+		{
+			/* 448 is 0700, 56 is 0070 and 511 is 0777 */
+			if('u' == mode[i]) who = who | 448;
+			else if('g' == mode[i]) who = who | 56;
+			else if('o' == mode[i]) who = who | 7;
+			else who = who | 511;
+			i = i + 1;
+		}
+		/* At least one +, - or = for each of ugoa */
+		if(!in_set(mode[i], "+-=")) return -1;
+		while(in_set(mode[i], "+-="))
+		{
+			op = mode[i];
+			i = i + 1;
+			bits = 0;
+			while(in_set(mode[i], "rwxX"))
+			{
+				/* 292 is 0444, 146 is 0222 and 73 is 0111 */
+				if('r' == mode[i]) bits = bits | 292;
+				else if('w' == mode[i]) bits = bits | 146;
+				else if('x' == mode[i]) bits = bits | 73;
+				else if(directory || (0 != (old & 73))) bits = bits | 73;
+				i = i + 1;
+			}
+			if(0 == who) bits = bits & ~mask;
+			else bits = bits & who;
+			if('+' == op) value = value | bits;
+			else if('-' == op) value = value & ~bits;
+			else
+			{
+				if(0 == who) value = value & ~511;
+				else value = value & ~who;
+				value = value | bits;
+			}
+		}
+		if(0 == mode[i]) return value;
+		if(',' != mode[i]) return -1;
+		i = i + 1;
+	}
+}
+
+/* mkdir [-p] [-m MODE] DIRECTORY... */
+int tool_mkdir(char** argv, int argc)
+{
+	int i;
+	int j;
+	int e;
+	int mode;
+	int made;
+	int mask = fs_umask();
+	int final = 511;
+	char* name;
+	char* part;
+	if(!tool_options(argv, argc, "pm") || !tool_plain_names(0)) return -1;
+	if(0 == tool_operand_count) return -1;
+	if(NULL != tool_mode)
+	{
+		final = tool_parse_mode(tool_mode, 511, TRUE);
+		if(0 > final) return -1;
+	}
+
+	for(i = 0; i < tool_operand_count; i = i + 1)
+	{
+		name = tool_operands[i];
+		if(tool_flags['p'] && (0 != name[0]))
+		{ /* Each directory on the way first */
+			part = arena_string(line_arena, name);
+			made = TRUE;
+			for(j = 1; made && (0 != part[j]); j = j + 1)
+			{
+				if(('/' != part[j]) || ('/' == part[j - 1])) continue;
+				part[j] = 0;
+				e = fs_mkdir(part, 511);
+				/* As the umask has it, but always u+wx (192 is 0300) */
+				if((0 == e) && (0 != (mask & 192))) fs_chmod(part, (511 & ~mask) | 192);
+				if(0 != e)
+				{
+					mode = fs_mode(part, TRUE);
+					if(0 <= mode) e = ERROR_NOTDIR;
+					if(!fs_is_directory(mode))
+					{
+						tool_error("mkdir", "cannot create directory", part, e);
+						made = FALSE;
+					}
+				}
+				part[j] = '/';
+			}
+			if(!made) continue;
+		}
+		e = fs_mkdir(name, final);
+		if(0 != e)
+		{
+			if(tool_flags['p'] && fs_is_directory(fs_mode(name, TRUE))) continue;
+			tool_error("mkdir", "cannot create directory", name, e);
+			continue;
+		}
+		if(NULL != tool_mode)
+		{ /* -m is not subject to the umask */
+			e = fs_chmod(name, final);
+			if(0 != e) tool_error("mkdir", "cannot set permissions of", name, e);
+		}
+	}
+	return tool_failed;
+}
+
+/* rm [-f] [-r] FILE... */
+int tool_rm(char** argv, int argc)
+{
+	int i;
+	int e;
+	int mode;
+	char* name;
+	char* base;
+	if(!tool_options(argv, argc, "frR") || !tool_plain_names(0)) return -1;
+	if((0 == tool_operand_count) && !tool_flags['f']) return -1;
+	for(i = 0; i < tool_operand_count; i = i + 1)
+	{ /* rm won't do these, and says so in its own way */
+		base = tool_basename(tool_operands[i]);
+		if(match(base, "/") || match(base, ".") || match(base, "..")) return -1;
+	}
+
+	for(i = 0; i < tool_operand_count; i = i + 1)
+	{
+		name = tool_operands[i];
+		mode = fs_mode(name, FALSE);
+		if(!fs_is_directory(mode)) e = fs_unlink(name);
+		else if(tool_flags['r'] || tool_flags['R']) e = fs_remove_tree(name);
+		else e = ERROR_ISDIR;
+		/* -f is only quiet about what isn't there */
+		if(tool_flags['f'] && (ERROR_NOENT == e)) e = 0;
+		if(0 != e) tool_error("rm", "cannot remove", name, e);
+	}
+	return tool_failed;
+}
+
+/* chmod MODE FILE... */
+int tool_chmod(char** argv, int argc)
+{
+	int i;
+	int e;
+	int old;
+	int mode;
+	char* name;
+	/* A mode like -x looks like an option; leave all of that to chmod */
+	if(!tool_options(argv, argc, "") || !tool_plain_names(1)) return -1;
+	if(2 > tool_operand_count) return -1;
+	if(0 > tool_parse_mode(tool_operands[0], 0, FALSE)) return -1;
+
+	for(i = 1; i < tool_operand_count; i = i + 1)
+	{
+		name = tool_operands[i];
+		old = fs_mode(name, TRUE);
+		if(0 > old)
+		{
+			tool_error("chmod", "cannot access", name, ERROR_NOENT);
+			continue;
+		}
+		/* 4095 is 07777, the permissions without the file type */
+		mode = tool_parse_mode(tool_operands[0], old & 4095, fs_is_directory(old));
+		e = fs_chmod(name, mode);
+		if(0 != e) tool_error("chmod", "changing permissions of", name, e);
+	}
+	return tool_failed;
+}
+
+/* touch [-c] FILE... */
+int tool_touch(char** argv, int argc)
+{
+	int i;
+	int e;
+	if(!tool_options(argv, argc, "c") || !tool_plain_names(0)) return -1;
+	if(0 == tool_operand_count) return -1;
+	for(i = 0; i < tool_operand_count; i = i + 1)
+	{ /* touch - is stdout */
+		if(match(tool_operands[i], "-")) return -1;
+	}
+
+	for(i = 0; i < tool_operand_count; i = i + 1)
+	{
+		e = fs_touch(tool_operands[i], !tool_flags['c']);
+		if(0 != e) tool_error("touch", "cannot touch", tool_operands[i], e);
+	}
+	return tool_failed;
+}
+
+/* mv [-f] SOURCE DEST, or mv [-f] SOURCE... DIRECTORY */
+int tool_mv(char** argv, int argc)
+{
+	int i;
+	int e;
+	int into;
+	int moved = 0;
+	char* last;
+	char* to;
+	if(!tool_options(argv, argc, "f") || !tool_plain_names(0)) return -1;
+	if(2 > tool_operand_count) return -1;
+	last = tool_operands[tool_operand_count - 1];
+	into = fs_is_directory(fs_mode(last, TRUE));
+	if(!into && (2 != tool_operand_count)) return -1;
+
+	/*
+	 * Anything mv has more to say about than rename() does is left to it,
+	 * before anything is moved: a source that isn't there, one that is
+	 * already where it is going or would go inside itself, and one on
+	 * another filesystem, which has to be copied.
+	 */
+	for(i = 0; i < tool_operand_count - 1; i = i + 1)
+	{
+		to = last;
+		if(into) to = tool_join(last, tool_basename(tool_operands[i]));
+		if(0 > fs_mode(tool_operands[i], FALSE)) return -1;
+		if(fs_same_file(tool_operands[i], to)) return -1;
+		if(fs_within(tool_operands[i], to)) return -1;
+		if(into && !fs_same_device(tool_operands[i], last)) return -1;
+	}
+
+	for(i = 0; i < tool_operand_count - 1; i = i + 1)
+	{
+		to = last;
+		if(into) to = tool_join(last, tool_basename(tool_operands[i]));
+		e = fs_rename(tool_operands[i], to);
+		/* Across mounts of the one filesystem too, found out only here; mv can still copy it if nothing has been done */
+		if((ERROR_XDEV == e) && (0 == moved) && (FALSE == tool_failed)) return -1;
+		if(0 != e) tool_error("mv", prepend_string("cannot move '", prepend_string(tool_operands[i], "' to")), to, e);
+		else moved = moved + 1;
+	}
+	return tool_failed;
+}
+
+/* ln [-s] [-f] [-n] TARGET [LINK], or ln [-sfn] TARGET... DIRECTORY */
+int tool_ln(char** argv, int argc)
+{
+	int i;
+	int e;
+	int into = FALSE;
+	int mode;
+	int count;
+	char* last;
+	char* name;
+	if(!tool_options(argv, argc, "sfn") || !tool_plain_names(0)) return -1;
+	if(0 == tool_operand_count) return -1;
+	count = tool_operand_count;
+	last = ".";
+	if(1 < count)
+	{
+		last = tool_operands[count - 1];
+		count = count - 1;
+		/* With -n a symlink to a directory is replaced, not gone into */
+		mode = fs_mode(last, !tool_flags['n']);
+		into = fs_is_directory(mode);
+		if(!into && (1 != count)) return -1;
+	}
+	else into = TRUE;
+	for(i = 0; !tool_flags['s'] && (i < count); i = i + 1)
+	{ /* A hard link to a directory is for ln to refuse, in its own words */
+		if(fs_is_directory(fs_mode(tool_operands[i], TRUE))) return -1;
+	}
+
+	for(i = 0; i < count; i = i + 1)
+	{
+		name = last;
+		if(into) name = tool_join(last, tool_basename(tool_operands[i]));
+		if(tool_flags['f'])
+		{ /* Out of the way first, unless it is a directory */
+			mode = fs_mode(name, FALSE);
+			if((0 <= mode) && !fs_is_directory(mode)) fs_unlink(name);
+		}
+		if(tool_flags['s'])
+		{
+			e = fs_symlink(tool_operands[i], name);
+			if(0 != e) tool_error("ln", "failed to create symbolic link", name, e);
+		}
+		else
+		{
+			e = fs_link(tool_operands[i], name);
+			if(0 != e) tool_error("ln", "failed to create hard link", name, e);
+		}
+	}
+	return tool_failed;
+}
+
+/* cp [-f] [-p] SOURCE DEST, or cp [-fp] SOURCE... DIRECTORY */
+int tool_cp(char** argv, int argc)
+{
+	int i;
+	int e;
+	int into;
+	char* last;
+	char** to;
+	if(!tool_options(argv, argc, "fp") || !tool_plain_names(0)) return -1;
+	if(2 > tool_operand_count) return -1;
+	last = tool_operands[tool_operand_count - 1];
+	into = fs_is_directory(fs_mode(last, TRUE));
+	if(!into && (2 != tool_operand_count)) return -1;
+	to = arena_calloc(line_arena, tool_operand_count, sizeof(char*));
+	for(i = 0; i < tool_operand_count - 1; i = i + 1)
+	{ /* Directories, and copying a file onto itself, are for cp to complain about */
+		if(fs_is_directory(fs_mode(tool_operands[i], TRUE))) return -1;
+		to[i] = last;
+		if(into) to[i] = tool_join(last, tool_basename(tool_operands[i]));
+		if(fs_same_file(tool_operands[i], to[i])) return -1;
+	}
+
+	for(i = 0; i < tool_operand_count - 1; i = i + 1)
+	{
+		if(0 > fs_mode(tool_operands[i], TRUE))
+		{
+			tool_error("cp", "cannot stat", tool_operands[i], ERROR_NOENT);
+			continue;
+		}
+		e = fs_copy(tool_operands[i], to[i], tool_flags['p']);
+		/* -f is for a to that can't be written, but can be replaced */
+		if((ERROR_ACCES == e) && tool_flags['f'] && (0 == fs_unlink(to[i]))) e = fs_copy(tool_operands[i], to[i], tool_flags['p']);
+		if(0 != e) tool_error("cp", "cannot create regular file", to[i], e);
+	}
+	return tool_failed;
+}
+
+/* cat FILE... (or stdin) to stdout */
+int tool_cat(char** argv, int argc)
+{
+	int i;
+	int e;
+	char** names;
+	int count;
+	if(!tool_options(argv, argc, "") || !tool_plain_names(0)) return -1;
+	names = tool_operands;
+	count = tool_operand_count;
+	if(0 == count)
+	{ /* Just cat is cat - */
+		names = arena_calloc(line_arena, 1, sizeof(char*));
+		names[0] = "-";
+		count = 1;
+	}
+
+	/* Anything kaem has printed comes first */
+	fflush(stdout);
+	for(i = 0; i < count; i = i + 1)
+	{
+		e = fs_cat(names[i]);
+		if(ERROR_PIPE == e)
+		{ /* Nothing is reading; SIGPIPE would have quietly stopped the real cat */
+			return TRUE;
+		}
+		if(0 != e)
+		{ /* cat doesn't quote the name */
+			file_print("cat: ", stderr);
+			file_print(names[i], stderr);
+			file_print(": ", stderr);
+			if(-1 == e) file_print("input file is output file", stderr);
+			else file_print(fs_error(e), stderr);
+			file_print("\n", stderr);
+			tool_failed = TRUE;
+		}
+	}
+	return tool_failed;
+}
+
+/* Say a file couldn't be hashed, as sha256sum does: "sha256sum: NAME: ERROR" */
+void tool_hash_error(char* name, int error)
+{
+	fflush(stdout);
+	file_print("sha256sum: ", stderr);
+	file_print(name, stderr);
+	file_print(": ", stderr);
+	file_print(fs_error(error), stderr);
+	file_print("\n", stderr);
+	tool_failed = TRUE;
+}
+
+/* One of sha256sum -c's closing warnings, if there is anything to warn of */
+void tool_hash_warning(int count, char* one, char* many)
+{
+	if(0 == count) return;
+	fflush(stdout);
+	file_print("sha256sum: WARNING: ", stderr);
+	file_print(numerate_number(count), stderr);
+	if(1 == count) file_print(one, stderr);
+	else file_print(many, stderr);
+	file_print("\n", stderr);
+	tool_failed = TRUE;
+}
+
+/* Hash the count files in names; each one's hash, or the errno in errors */
+char** tool_hash_files(char** names, int count, int* errors)
+{
+	char** hashes = arena_calloc(line_arena, count + 1, sizeof(char*));
+	int i;
+	for(i = 0; i < count; i = i + 1) hashes[i] = arena_calloc(line_arena, 65, sizeof(char));
+	fs_hash_files(names, count, hashes, errors);
+	return hashes;
+}
+
+/* Does a line of a sha256sum manifest hold a hash for checking */
+int tool_hash_line(char* line)
+{
+	int i;
+	for(i = 0; i < 64; i = i + 1)
+	{
+		if(!in_set(line[i], "0123456789abcdefABCDEF")) return FALSE;
+	}
+	if((' ' != line[64]) || !in_set(line[65], " *")) return FALSE;
+	return (0 != line[66]) && tool_plain(line + 66);
+}
+
+/*
+ * sha256sum -c MANIFEST...; every manifest is read and every file in them
+ * hashed (side by side) before anything is said. Anything in a manifest
+ * that isn't a hash and a name, and it is left to sha256sum.
+ */
+int tool_sha256sum_check()
+{
+	int m;
+	int i;
+	int j;
+	int count = 0;
+	int length;
+	int c;
+	int unreadable;
+	int mismatched;
+	int found;
+	struct Buffer** texts = arena_calloc(line_arena, tool_operand_count, sizeof(struct Buffer*));
+	char** names;
+	char** expected;
+	int* owner;
+	int* errors;
+	char** hashes;
+	char* line;
+	FILE* f;
+
+	for(m = 0; m < tool_operand_count; m = m + 1)
+	{
+		if(match(tool_operands[m], "-")) return -1;
+		f = fopen(tool_operands[m], "r");
+		if(NULL == f) return -1;
+		texts[m] = buffer_new(line_arena, 4096);
+		c = fgetc(f);
+		while(EOF != c)
+		{
+			if('\n' == c) count = count + 1;
+			buffer_add_char(texts[m], c);
+			c = fgetc(f);
+		}
+		fclose(f);
+		/* The last line need not have a newline */
+		buffer_add_char(texts[m], '\n');
+		buffer_add_char(texts[m], 0);
+		count = count + 1;
+	}
+
+	names = arena_calloc(line_arena, count + 1, sizeof(char*));
+	expected = arena_calloc(line_arena, count + 1, sizeof(char*));
+	owner = arena_calloc(line_arena, count + 1, sizeof(int));
+	errors = arena_calloc(line_arena, count + 1, sizeof(int));
+	count = 0;
+	for(m = 0; m < tool_operand_count; m = m + 1)
+	{
+		found = FALSE;
+		length = texts[m]->length - 1;
+		line = texts[m]->text;
+		for(i = 0; i < length; i = i + 1)
+		{
+			if('\n' != texts[m]->text[i]) continue;
+			texts[m]->text[i] = 0;
+			/* The newline added above ends an empty line when there was one already */
+			if((i + 1 == length) && (line == texts[m]->text + i)) break;
+			if('#' != line[0])
+			{
+				if(!tool_hash_line(line)) return -1;
+				names[count] = line + 66;
+				expected[count] = line;
+				owner[count] = m;
+				count = count + 1;
+				found = TRUE;
+			}
+			line = texts[m]->text + i + 1;
+		}
+		/* sha256sum says so, in its own way */
+		if(!found) return -1;
+	}
+
+	hashes = tool_hash_files(names, count, errors);
+	i = 0;
+	for(m = 0; m < tool_operand_count; m = m + 1)
+	{
+		unreadable = 0;
+		mismatched = 0;
+		for(; (i < count) && (m == owner[i]); i = i + 1)
+		{
+			if(0 != errors[i])
+			{
+				tool_hash_error(names[i], errors[i]);
+				file_print(names[i], stdout);
+				file_print(": FAILED open or read\n", stdout);
+				unreadable = unreadable + 1;
+				continue;
+			}
+			for(j = 0; j < 64; j = j + 1)
+			{ /* Either case will do */
+				c = expected[i][j];
+				if(in_set(c, "ABCDEF")) c = c + ('a' - 'A');
+				if(c != hashes[i][j]) break;
+			}
+			file_print(names[i], stdout);
+			if(64 == j) file_print(": OK\n", stdout);
+			else
+			{
+				file_print(": FAILED\n", stdout);
+				mismatched = mismatched + 1;
+			}
+		}
+		tool_hash_warning(unreadable, " listed file could not be read", " listed files could not be read");
+		tool_hash_warning(mismatched, " computed checksum did NOT match", " computed checksums did NOT match");
+	}
+	return tool_failed;
+}
+
+/* sha256sum [-b | -t] FILE..., or sha256sum -c MANIFEST... */
+int tool_sha256sum(char** argv, int argc)
+{
+	int i;
+	int* errors;
+	char** hashes;
+	if(!tool_options(argv, argc, "cbt") || !tool_plain_names(0)) return -1;
+	if(0 == tool_operand_count) return -1;
+	if(tool_flags['c'])
+	{ /* -b and -t are for making a manifest, not checking one */
+		if(tool_flags['b'] || tool_flags['t']) return -1;
+		return tool_sha256sum_check();
+	}
+	for(i = 0; i < tool_operand_count; i = i + 1)
+	{ /* sha256sum - is stdin */
+		if(match(tool_operands[i], "-")) return -1;
+	}
+
+	errors = arena_calloc(line_arena, tool_operand_count, sizeof(int));
+	hashes = tool_hash_files(tool_operands, tool_operand_count, errors);
+	for(i = 0; i < tool_operand_count; i = i + 1)
+	{
+		if(0 != errors[i])
+		{
+			tool_hash_error(tool_operands[i], errors[i]);
+			continue;
+		}
+		file_print(hashes[i], stdout);
+		if(tool_flags['b']) file_print(" *", stdout);
+		else file_print("  ", stdout);
+		file_print(tool_operands[i], stdout);
+		fputc('\n', stdout);
+	}
+	return tool_failed;
+}
+
+/*
+ * Do what the program in argv would have done; its exit status, or -1 if
+ * it is something to leave to the real program.
+ */
+int run_tool(int tool, char** argv, int argc)
+{
+	if(!TOOLS || !fs_supported()) return -1;
+	if(BUILTIN_MKDIR == tool) return tool_mkdir(argv, argc);
+	if(BUILTIN_RM == tool) return tool_rm(argv, argc);
+	if(BUILTIN_CHMOD == tool) return tool_chmod(argv, argc);
+	if(BUILTIN_TOUCH == tool) return tool_touch(argv, argc);
+	if(BUILTIN_MV == tool) return tool_mv(argv, argc);
+	if(BUILTIN_LN == tool) return tool_ln(argv, argc);
+	if(BUILTIN_CP == tool) return tool_cp(argv, argc);
+	if(BUILTIN_CAT == tool) return tool_cat(argv, argc);
+	if(BUILTIN_SHA256SUM == tool) return tool_sha256sum(argv, argc);
+	return -1;
+}